@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Slab header size, rounded so that the data after it is well aligned
+#define SLAB_HEADER_SIZE ((sizeof(ArenaSlab) + 63) & ~(size_t)63)
+
+void arena_init(Arena *arena, size_t slab_size) {
+    arena->slabs = NULL;
+    arena->slab_size = slab_size;
+    arena->total = 0;
+}
+
+void arena_free(Arena *arena) {
+    ArenaSlab *slab = arena->slabs;
+    while (slab != NULL) {
+        ArenaSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    arena->slabs = NULL;
+    arena->total = 0;
+}
+
+// Offset of the first suitably aligned free byte in a slab
+static size_t aligned_offset(const ArenaSlab *slab, size_t align) {
+    uintptr_t base = (uintptr_t)slab + SLAB_HEADER_SIZE;
+    return (size_t)(((base + slab->used + align - 1) & ~(uintptr_t)(align - 1)) - base);
+}
+
+// Function to bump-allocate from the current slab, starting a new slab when it is full
+void *arena_alloc(Arena *arena, size_t size, size_t align) {
+    ArenaSlab *slab = arena->slabs;
+    if (slab != NULL) {
+        size_t offset = aligned_offset(slab, align);
+        if (offset + size <= slab->size) {
+            slab->used = offset + size;
+            return (char *)slab + SLAB_HEADER_SIZE + offset;
+        }
+    }
+
+    // Large requests get a slab of their own so the current slab keeps its free space
+    size_t slab_size = arena->slab_size;
+    int dedicated = size + align > slab_size / 4;
+    if (dedicated) {
+        slab_size = size + align;
+    }
+
+    slab = malloc(SLAB_HEADER_SIZE + slab_size);
+    if (slab == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    slab->size = slab_size;
+    slab->used = 0;
+    arena->total += slab_size;
+
+    if (dedicated && arena->slabs != NULL) {
+        // Keep the partially used slab at the head for later small allocations
+        slab->next = arena->slabs->next;
+        arena->slabs->next = slab;
+    } else {
+        slab->next = arena->slabs;
+        arena->slabs = slab;
+    }
+
+    size_t offset = aligned_offset(slab, align);
+    slab->used = offset + size;
+    return (char *)slab + SLAB_HEADER_SIZE + offset;
+}
+
+void string_pool_init(StringPool *pool) {
+    memset(pool, 0, sizeof(*pool));
+}
+
+void string_pool_free(StringPool *pool) {
+    free(pool->strings);
+    free(pool->lengths);
+    free(pool->slots);
+    memset(pool, 0, sizeof(*pool));
+}
+
+static uint32_t hash_string(const char *str, size_t length) {
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint32_t string_pool_find(const StringPool *pool, const char *str, size_t length) {
+    if (pool->slot_count == 0) return STRING_POOL_NONE;
+
+    uint32_t mask = pool->slot_count - 1;
+    for (uint32_t slot = hash_string(str, length) & mask; pool->slots[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t id = pool->slots[slot] - 1;
+        if (pool->lengths[id] == length && memcmp(pool->strings[id], str, length) == 0) {
+            return id;
+        }
+    }
+    return STRING_POOL_NONE;
+}
+
+// Function to double the hash table and re-insert every id
+static int grow_slots(StringPool *pool) {
+    uint32_t slot_count = pool->slot_count ? pool->slot_count * 2 : 64;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+
+    uint32_t mask = slot_count - 1;
+    for (uint32_t id = 0; id < pool->count; id++) {
+        uint32_t slot = hash_string(pool->strings[id], pool->lengths[id]) & mask;
+        while (slots[slot] != 0) slot = (slot + 1) & mask;
+        slots[slot] = id + 1;
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_count = slot_count;
+    return 1;
+}
+
+uint32_t string_pool_intern(StringPool *pool, Arena *arena, const char *str, size_t length) {
+    uint32_t id = string_pool_find(pool, str, length);
+    if (id != STRING_POOL_NONE) return id;
+
+    // Keep the hash table at most half full
+    if ((pool->count + 1) * 2 > pool->slot_count && !grow_slots(pool)) {
+        return STRING_POOL_NONE;
+    }
+    if (pool->count == pool->capacity) {
+        uint32_t capacity = pool->capacity ? pool->capacity * 2 : 64;
+        const char **strings = realloc(pool->strings, capacity * sizeof(char *));
+        if (strings == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return STRING_POOL_NONE;
+        }
+        pool->strings = strings;
+        uint32_t *lengths = realloc(pool->lengths, capacity * sizeof(uint32_t));
+        if (lengths == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return STRING_POOL_NONE;
+        }
+        pool->lengths = lengths;
+        pool->capacity = capacity;
+    }
+
+    char *copy = arena_alloc(arena, length + 1, 1);
+    if (copy == NULL) return STRING_POOL_NONE;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+
+    id = pool->count++;
+    pool->strings[id] = copy;
+    pool->lengths[id] = (uint32_t)length;
+
+    uint32_t mask = pool->slot_count - 1;
+    uint32_t slot = hash_string(str, length) & mask;
+    while (pool->slots[slot] != 0) slot = (slot + 1) & mask;
+    pool->slots[slot] = id + 1;
+    return id;
+}
@@ -0,0 +1,56 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_SLAB_SIZE (1 << 20)  // Default size of each slab handed out by the arena
+
+// One block of memory that allocations are carved from
+typedef struct ArenaSlab {
+    struct ArenaSlab *next;
+    size_t size;
+    size_t used;
+} ArenaSlab;
+
+// A bump allocator: allocations are taken from large slabs and are all
+// released together when the arena is freed.
+typedef struct {
+    ArenaSlab *slabs;
+    size_t slab_size;
+    size_t total;  // Bytes reserved in all slabs
+} Arena;
+
+void arena_init(Arena *arena, size_t slab_size);
+void arena_free(Arena *arena);
+
+// Allocate size bytes aligned to align (a power of two); returns NULL on failure
+void *arena_alloc(Arena *arena, size_t size, size_t align);
+
+// Interned strings: each distinct string is stored once in an arena and
+// referred to by a small integer id.
+typedef struct {
+    const char **strings;  // id -> NUL-terminated string
+    uint32_t *lengths;     // id -> length
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *slots;       // Open addressing hash table of id + 1, 0 when empty
+    uint32_t slot_count;
+} StringPool;
+
+#define STRING_POOL_NONE UINT32_MAX  // Returned when a string is absent or cannot be stored
+
+void string_pool_init(StringPool *pool);
+void string_pool_free(StringPool *pool);
+
+// Return the id of a string, adding a copy of it to the arena if it is new
+uint32_t string_pool_intern(StringPool *pool, Arena *arena, const char *str, size_t length);
+
+// Return the id of a string, or STRING_POOL_NONE if it was never interned
+uint32_t string_pool_find(const StringPool *pool, const char *str, size_t length);
+
+static inline const char *string_pool_get(const StringPool *pool, uint32_t id) {
+    return pool->strings[id];
+}
+
+#endif
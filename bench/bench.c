@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "table.h"
+#include "loader.h"
+#include "plan.h"
+#include "kernels.h"
+#include "fields.h"
+
+// The operations timed on every file, each run on its own against all rows
+static const char *operations[] = {
+    "filter-state:CA",
+    "filter:Education.Bachelor's Degree or Higher:ge:40",
+    "filter:Income.Median Household Income:le:40000",
+    "population-total",
+    "population:Ethnicities.Black Alone",
+    "percent:Income.Persons Below Poverty Level",
+    "group-by:State\npopulation-total",
+    "display"
+};
+
+#define OPERATION_COUNT ((int)(sizeof(operations) / sizeof(operations[0])))
+#define PHASE_COUNT (OPERATION_COUNT + 1)  // Loading, then each operation
+
+// Timings of one phase over the repeated runs
+typedef struct {
+    double *seconds;
+    double bytes;  // Bytes the phase reads per run
+} Phase;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to time one operation against every row of the table
+static double run_operation(const char *text, const Table *table, const Config *config, int threads, FILE *sink, double *bytes) {
+    FILE *script = fmemopen((void *)text, strlen(text), "r");
+    Plan plan;
+    Selection selection;
+    if (script == NULL || !plan_compile(&plan, script, table, config)) {
+        fprintf(stderr, "Could not compile %s\n", text);
+        exit(1);
+    }
+    fclose(script);
+
+    // Bytes of column data the operation reads
+    unsigned char *columns = calloc(config->valid_fields_count, 1);
+    int column_count = 0;
+    if (columns == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    plan_columns(&plan, config, columns);
+    for (int i = 0; i < config->valid_fields_count; i++) {
+        column_count += columns[i];
+    }
+    free(columns);
+    *bytes = (double)table->row_count * column_count * sizeof(uint32_t);
+
+    Output output;
+    if (!selection_init_all(&selection, table->row_count) || !output_init(&output, sink, sink, OUTPUT_HUMAN)) {
+        exit(1);
+    }
+    double start = now();
+    plan_execute(&plan, table, &selection, config, threads, &output, NULL);
+    output_free(&output);
+    fflush(sink);
+    double elapsed = now() - start;
+
+    selection_free(&selection);
+    plan_free(&plan);
+    return elapsed;
+}
+
+// Function to load the file and time every operation on it once
+static int run_once(const char *path, int threads, FILE *sink, Phase *phases, int run, int *row_count) {
+    Config config;
+    DemographicsFile input;
+    Table table;
+
+    if (!config_init(&config, valid_fields, print_formats, field_types, valid_fields_count)) {
+        return 0;
+    }
+
+    // Malformed entries are reported while loading; send them to the sink
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(fileno(sink), STDERR_FILENO);
+    double start = now();
+    int ok = open_demographics_file(path, &input, &config);
+    int records = ok ? process_demographics_file(&input, &table, &config, NULL, threads) : -1;
+    phases[0].seconds[run] = now() - start;
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    if (!ok || records < 0) {
+        fprintf(stderr, "Could not load %s\n", path);
+        if (ok) close_demographics_file(&input);
+        config_free(&config);
+        return 0;
+    }
+    phases[0].bytes = input.file.size;
+    close_demographics_file(&input);
+    *row_count = records;
+
+    for (int i = 0; i < OPERATION_COUNT; i++) {
+        phases[i + 1].seconds[run] = run_operation(operations[i], &table, &config, threads, sink, &phases[i + 1].bytes);
+    }
+
+    table_free(&table);
+    config_free(&config);
+    return 1;
+}
+
+// Function to print the mean and spread of every phase
+static void report(const char *path, const Phase *phases, int runs, int row_count) {
+    printf("%s: %d rows, %.1f MB, %d runs\n", path, row_count, phases[0].bytes / 1e6, runs);
+    printf("%-52s %10s %10s %10s %14s %10s\n", "phase", "mean ms", "stddev ms", "min ms", "rows/s", "MB/s");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double sum = 0, squares = 0, min = phases[p].seconds[0];
+        for (int r = 0; r < runs; r++) {
+            sum += phases[p].seconds[r];
+            if (phases[p].seconds[r] < min) min = phases[p].seconds[r];
+        }
+        double mean = sum / runs;
+        for (int r = 0; r < runs; r++) {
+            squares += (phases[p].seconds[r] - mean) * (phases[p].seconds[r] - mean);
+        }
+        double stddev = runs > 1 ? sqrt(squares / (runs - 1)) : 0;
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s", p == 0 ? "load" : operations[p - 1]);
+        for (char *c = name; *c; c++) {
+            if (*c == '\n') *c = ' ';
+        }
+        printf("%-52s %10.3f %10.3f %10.3f %14.0f %10.1f\n", name, mean * 1e3, stddev * 1e3, min * 1e3,
+               mean > 0 ? row_count / mean : 0, mean > 0 ? phases[p].bytes / mean / 1e6 : 0);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int runs = 5;
+    int threads = 1;
+    int arg = 1;
+
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-r") == 0) {
+            runs = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-j") == 0) {
+            threads = atoi(argv[arg + 1]);
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (arg >= argc || runs < 1 || threads < 1) {
+        fprintf(stderr, "Usage: %s [-r runs] [-j threads] <demographics_file>...\n", argv[0]);
+        return 1;
+    }
+
+    FILE *sink = fopen("/dev/null", "w");
+    if (sink == NULL) {
+        fprintf(stderr, "Could not open /dev/null\n");
+        return 1;
+    }
+    kernels_init();
+    printf("kernels: %s, threads: %d\n\n", kernels()->name, threads);
+
+    Phase phases[PHASE_COUNT];
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        phases[p].seconds = calloc(runs, sizeof(double));
+        if (phases[p].seconds == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 1;
+        }
+    }
+
+    int status = 0;
+    for (; arg < argc; arg++) {
+        int row_count = 0;
+        int ok = 1;
+        for (int r = 0; r < runs && ok; r++) {
+            ok = run_once(argv[arg], threads, sink, phases, r, &row_count);
+        }
+        if (ok) {
+            report(argv[arg], phases, runs, row_count);
+        } else {
+            status = 1;
+        }
+    }
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        free(phases[p].seconds);
+    }
+    fclose(sink);
+    return status;
+}
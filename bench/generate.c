@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "csv.h"
+
+#define MAX_TOKENS 100
+#define MALFORMED_RATE 1000  // One malformed line in this many
+#define SPECIAL_RATE 50      // One county name needing escapes in this many
+#define OUTPUT_BLOCK (1 << 20)  // Bytes formatted before they are written out
+#define MAX_NUMBER 64           // Longest formatted number, quotes included
+
+// One column of the seed file
+typedef struct {
+    int numeric;     // Every seed value is a number
+    double max;      // Largest seed value, so percentages stay at or below 100
+} SeedColumn;
+
+// One seed value read as a number
+typedef struct {
+    double value;
+    int decimals;      // Digits after the decimal point in the seed text
+} SeedNumber;
+
+// The rows of the seed file, as field spans into its mapping
+typedef struct {
+    MappedFile file;
+    size_t header_end;
+    CsvField *fields;  // row_count * column_count spans
+    SeedNumber *numbers;  // The same fields read as numbers, for numeric columns
+    int row_count;
+    int column_count;
+    SeedColumn *columns;
+} Seed;
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+
+// xorshift64*, so the same seed always gives the same file
+static uint64_t next_random(void) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545f4914f6cdd1dULL;
+}
+
+static double random_unit(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Function to read a seed value as a double, noting its decimals
+static void read_number(const char *text, size_t length, SeedNumber *number) {
+    char value[64];
+    size_t n = length < sizeof(value) - 1 ? length : sizeof(value) - 1;
+    memcpy(value, text, n);
+    value[n] = '\0';
+
+    const char *point = strchr(value, '.');
+    number->decimals = point != NULL ? (int)strlen(point + 1) : 0;
+    number->value = atof(value);
+}
+
+// Function to read the seed file and note which columns are numeric
+static int read_seed(const char *path, Seed *seed) {
+    CsvField fields[MAX_TOKENS];
+    int lines = 0;
+    size_t pos = 0;
+
+    memset(seed, 0, sizeof(*seed));
+    if (!map_file(path, &seed->file)) {
+        fprintf(stderr, "Could not open file: %s\n", path);
+        return 0;
+    }
+    seed->column_count = csv_next_record(seed->file.data, seed->file.size, &pos, fields, MAX_TOKENS, &lines);
+    if (seed->column_count <= 0 || seed->column_count > MAX_TOKENS) {
+        fprintf(stderr, "Failed to read header or invalid format\n");
+        return 0;
+    }
+    seed->header_end = pos;
+
+    int capacity = 4096;
+    seed->fields = malloc(capacity * seed->column_count * sizeof(CsvField));
+    seed->numbers = malloc(capacity * seed->column_count * sizeof(SeedNumber));
+    seed->columns = calloc(seed->column_count, sizeof(SeedColumn));
+    if (seed->fields == NULL || seed->numbers == NULL || seed->columns == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    for (int c = 0; c < seed->column_count; c++) {
+        seed->columns[c].numeric = 1;
+    }
+
+    for (;;) {
+        int count = csv_next_record(seed->file.data, seed->file.size, &pos, fields, MAX_TOKENS, &lines);
+        if (count < 0) break;
+        if (count != seed->column_count) continue;  // Only complete rows are used as models
+        if (seed->row_count == capacity) {
+            capacity *= 2;
+            CsvField *grown = realloc(seed->fields, capacity * seed->column_count * sizeof(CsvField));
+            if (grown != NULL) {
+                seed->fields = grown;
+            }
+            SeedNumber *grown_numbers = realloc(seed->numbers, capacity * seed->column_count * sizeof(SeedNumber));
+            if (grown_numbers != NULL) {
+                seed->numbers = grown_numbers;
+            }
+            if (grown == NULL || grown_numbers == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                return 0;
+            }
+        }
+        memcpy(seed->fields + (size_t)seed->row_count * seed->column_count, fields, seed->column_count * sizeof(CsvField));
+        for (int c = 0; c < seed->column_count; c++) {
+            float value;
+            if (!csv_parse_float(seed->file.data + fields[c].offset, fields[c].length, &value)) {
+                seed->columns[c].numeric = 0;
+                continue;
+            }
+            if (value > seed->columns[c].max) {
+                seed->columns[c].max = value;
+            }
+            read_number(seed->file.data + fields[c].offset, fields[c].length,
+                        &seed->numbers[(size_t)seed->row_count * seed->column_count + c]);
+        }
+        seed->row_count++;
+    }
+    if (seed->row_count == 0) {
+        fprintf(stderr, "No complete rows in %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+// Output staged in a large block, so that rows are formatted with plain
+// stores and written out a block at a time
+typedef struct {
+    FILE *file;
+    char *data;
+    size_t used;
+    int failed;
+} Output;
+
+// Function to make room for length more bytes, writing out the block if needed
+static char *output_reserve(Output *out, size_t length) {
+    if (out->used + length > OUTPUT_BLOCK) {
+        if (fwrite(out->data, 1, out->used, out->file) != out->used) {
+            out->failed = 1;
+        }
+        out->used = 0;
+    }
+    return out->data + out->used;
+}
+
+static void output_bytes(Output *out, const char *bytes, size_t length) {
+    if (length > OUTPUT_BLOCK) {
+        output_reserve(out, OUTPUT_BLOCK);  // Write out what is staged first
+        if (fwrite(bytes, 1, length, out->file) != length) {
+            out->failed = 1;
+        }
+        return;
+    }
+    memcpy(output_reserve(out, length), bytes, length);
+    out->used += length;
+}
+
+static void output_string(Output *out, const char *text) {
+    output_bytes(out, text, strlen(text));
+}
+
+static void output_char(Output *out, char c) {
+    *output_reserve(out, 1) = c;
+    out->used++;
+}
+
+// Function to format value with the given decimals, as "%.*f" does, into
+// dest. Values that fit in 15 digits are rounded and printed as integers;
+// the rest go through snprintf. Returns the length.
+static size_t format_fixed(char *dest, size_t size, double value, int decimals) {
+    static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    if (decimals > 9 || !(fabs(value) * powers_of_ten[decimals < 0 ? 0 : decimals] < 1e15)) {
+        int n = snprintf(dest, size, "%.*f", decimals, value);
+        return n < 0 ? 0 : ((size_t)n < size ? (size_t)n : size - 1);
+    }
+
+    char digits[24];
+    int count = 0;
+    int negative = value < 0;
+    unsigned long long scaled = (unsigned long long)llround(fabs(value) * powers_of_ten[decimals]);
+    do {
+        digits[count++] = (char)('0' + scaled % 10);
+        scaled /= 10;
+    } while (scaled != 0 || count <= decimals);  // At least one digit before the point
+
+    size_t n = 0;
+    if (negative) dest[n++] = '-';
+    while (count > 0) {
+        if (count == decimals) dest[n++] = '.';
+        dest[n++] = digits[--count];
+    }
+    return n;
+}
+
+// Function to write a seed value scaled by a random factor, with the same
+// number of decimals as the seed value
+static void write_number(Output *out, const SeedNumber *number, const SeedColumn *column) {
+    double scaled = number->value * (0.9 + 0.2 * random_unit());
+    if (column->max <= 100 && scaled > 100) {
+        scaled = 100;
+    }
+    char *dest = output_reserve(out, MAX_NUMBER);
+    size_t n = 0;
+    dest[n++] = '"';
+    n += format_fixed(dest + n, MAX_NUMBER - 2, scaled, number->decimals);
+    dest[n++] = '"';
+    out->used += n;
+}
+
+// Function to write a county name, sometimes with a comma, a quote or a
+// newline so that the quoting rules of the reader are exercised
+static void write_county(Output *out, const char *text, size_t length, long row) {
+    output_char(out, '"');
+    output_bytes(out, text, length);
+    switch (next_random() % SPECIAL_RATE) {
+        case 0: output_string(out, ", City of"); break;
+        case 1: output_string(out, " \"\"Old\"\""); break;
+        case 2: output_string(out, "\nUnit"); break;
+        default: break;
+    }
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), " %ld\"", row);
+    output_string(out, suffix);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <seed_csv> <rows> <output_csv> [random_seed]\n", argv[0]);
+        return 1;
+    }
+    long rows = atol(argv[2]);
+    if (argc > 4) {
+        random_state ^= strtoull(argv[4], NULL, 10);
+    }
+
+    Seed seed;
+    if (!read_seed(argv[1], &seed)) {
+        return 1;
+    }
+    static char block[OUTPUT_BLOCK];
+    Output out = { fopen(argv[3], "w"), block, 0, 0 };
+    if (out.file == NULL) {
+        fprintf(stderr, "Could not open file: %s\n", argv[3]);
+        return 1;
+    }
+
+    const char *data = seed.file.data;
+    output_bytes(&out, data, seed.header_end);
+    for (long row = 0; row < rows; row++) {
+        size_t model = (size_t)(next_random() % seed.row_count) * seed.column_count;
+        const CsvField *fields = seed.fields + model;
+        int malformed = next_random() % MALFORMED_RATE == 0;
+        int columns = malformed && next_random() % 2 ? seed.column_count / 2 : seed.column_count;
+        int broken = malformed && columns == seed.column_count ? 2 + (int)(next_random() % (seed.column_count - 2)) : -1;
+
+        for (int c = 0; c < columns; c++) {
+            const CsvField *field = &fields[c];
+            if (c > 0) output_char(&out, ',');
+            if (c == broken) {
+                output_string(&out, "\"(X)\"");  // Not a number; the reader skips the line if the column is required
+            } else if (c == 0) {
+                write_county(&out, data + field->offset, field->length, row);
+            } else if (seed.columns[c].numeric) {
+                write_number(&out, &seed.numbers[model + c], &seed.columns[c]);
+            } else {
+                output_char(&out, '"');
+                output_bytes(&out, data + field->offset, field->length);
+                output_char(&out, '"');
+            }
+        }
+        output_char(&out, '\n');
+    }
+
+    output_reserve(&out, OUTPUT_BLOCK);  // Write out the last block
+    if (fclose(out.file) != 0 || out.failed) {
+        fprintf(stderr, "Could not write %s\n", argv[3]);
+        return 1;
+    }
+    unmap_file(&seed.file);
+    free(seed.fields);
+    free(seed.numbers);
+    free(seed.columns);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+// Compressed bitmaps are a list of marker words, each followed by the
+// literal words it announces. A marker stands for a run of words that are
+// all zeros or all ones (bit 0: which, bits 1-31: run length), followed by
+// literal words copied as they are (bits 32-63: how many).
+#define RUN_MAX UINT32_C(0x7fffffff)
+#define LITERAL_MAX UINT32_C(0xffffffff)
+
+static uint64_t marker(uint64_t ones, uint64_t run, uint64_t literals) {
+    return ones | run << 1 | literals << 32;
+}
+
+typedef struct CacheEntry {
+    struct CacheEntry *newer;  // Entries in order of use, most recent first
+    struct CacheEntry *older;
+    char *key;
+    uint64_t *words;           // The compressed bitmap
+    size_t word_count;
+    int *counts;
+    int filter_count;
+    size_t bytes;              // Memory charged to the entry
+} CacheEntry;
+
+struct FilterCache {
+    pthread_mutex_t lock;
+    CacheEntry *newest;
+    CacheEntry *oldest;
+    size_t bytes;
+    size_t capacity;
+};
+
+FilterCache *filter_cache_create(size_t capacity) {
+    FilterCache *cache = calloc(1, sizeof(FilterCache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->capacity = capacity;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static void free_entry(CacheEntry *entry) {
+    free(entry->key);
+    free(entry->words);
+    free(entry->counts);
+    free(entry);
+}
+
+void filter_cache_free(FilterCache *cache) {
+    if (cache == NULL) return;
+    CacheEntry *entry = cache->newest;
+    while (entry != NULL) {
+        CacheEntry *older = entry->older;
+        free_entry(entry);
+        entry = older;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+static void unlink_entry(FilterCache *cache, CacheEntry *entry) {
+    if (entry->newer != NULL) entry->newer->older = entry->older; else cache->newest = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer; else cache->oldest = entry->newer;
+    cache->bytes -= entry->bytes;
+}
+
+static void push_newest(FilterCache *cache, CacheEntry *entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) cache->newest->newer = entry; else cache->oldest = entry;
+    cache->newest = entry;
+    cache->bytes += entry->bytes;
+}
+
+static CacheEntry *find_entry(FilterCache *cache, const char *key) {
+    for (CacheEntry *entry = cache->newest; entry != NULL; entry = entry->older) {
+        if (strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Function to compress a bitmap of count words. Returns the compressed
+// words (at most count + count / 2 + 1 of them) or NULL.
+static uint64_t *compress(const uint64_t *bits, size_t count, size_t *compressed_count) {
+    uint64_t *out = malloc((count + count / 2 + 1) * sizeof(uint64_t));
+    size_t length = 0;
+    size_t i = 0;
+    if (out == NULL) {
+        return NULL;
+    }
+    while (i < count) {
+        uint64_t ones = bits[i] == ~UINT64_C(0);
+        uint64_t clean = ones ? ~UINT64_C(0) : 0;
+        uint64_t run = 0, literals = 0;
+        while (i < count && bits[i] == clean && run < RUN_MAX) {
+            run++;
+            i++;
+        }
+        size_t at = length++;
+        while (i < count && bits[i] != 0 && bits[i] != ~UINT64_C(0) && literals < LITERAL_MAX) {
+            out[length++] = bits[i++];
+            literals++;
+        }
+        out[at] = marker(ones, run, literals);
+    }
+    *compressed_count = length;
+    uint64_t *shrunk = realloc(out, (length > 0 ? length : 1) * sizeof(uint64_t));
+    return shrunk != NULL ? shrunk : out;
+}
+
+// Function to expand a compressed bitmap into count words
+static void expand(const uint64_t *words, size_t word_count, uint64_t *bits, size_t count) {
+    size_t at = 0;
+    for (size_t i = 0; i < word_count && at < count; ) {
+        uint64_t word = words[i++];
+        uint64_t clean = (word & 1) ? ~UINT64_C(0) : 0;
+        size_t run = (size_t)((word >> 1) & RUN_MAX);
+        size_t literals = (size_t)(word >> 32);
+        for (size_t j = 0; j < run && at < count; j++) {
+            bits[at++] = clean;
+        }
+        for (size_t j = 0; j < literals && at < count; j++) {
+            bits[at++] = words[i++];
+        }
+    }
+    memset(bits + at, 0, (count - at) * sizeof(uint64_t));
+}
+
+int filter_cache_get(const Table *table, const char *key, Selection *selection, int *counts, int filter_count) {
+    FilterCache *cache = table->cache;
+    if (cache == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = find_entry(cache, key);
+    int found = entry != NULL && entry->filter_count == filter_count;
+    if (found) {
+        unlink_entry(cache, entry);
+        push_newest(cache, entry);
+        expand(entry->words, entry->word_count, selection->bits, SELECTION_WORDS(selection->row_count));
+        memcpy(counts, entry->counts, filter_count * sizeof(int));
+        selection->count = filter_count > 0 ? counts[filter_count - 1] : selection->row_count;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+void filter_cache_put(const Table *table, const char *key, const Selection *selection, const int *counts, int filter_count) {
+    FilterCache *cache = table->cache;
+    if (cache == NULL) {
+        return;
+    }
+
+    // Compress outside the lock; other scripts only wait for the list
+    CacheEntry *entry = calloc(1, sizeof(CacheEntry));
+    if (entry == NULL) {
+        return;
+    }
+    entry->key = malloc(strlen(key) + 1);
+    entry->counts = malloc((filter_count > 0 ? filter_count : 1) * sizeof(int));
+    entry->words = compress(selection->bits, SELECTION_WORDS(selection->row_count), &entry->word_count);
+    if (entry->key == NULL || entry->counts == NULL || entry->words == NULL) {
+        free_entry(entry);
+        return;
+    }
+    strcpy(entry->key, key);
+    memcpy(entry->counts, counts, filter_count * sizeof(int));
+    entry->filter_count = filter_count;
+    entry->bytes = sizeof(CacheEntry) + strlen(key) + 1 + entry->word_count * sizeof(uint64_t) + filter_count * sizeof(int);
+    if (entry->bytes > cache->capacity) {
+        free_entry(entry);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *old = find_entry(cache, key);
+    if (old != NULL) {
+        unlink_entry(cache, old);  // Another script got there first
+        free_entry(old);
+    }
+    while (cache->bytes + entry->bytes > cache->capacity) {
+        CacheEntry *oldest = cache->oldest;
+        unlink_entry(cache, oldest);
+        free_entry(oldest);
+    }
+    push_newest(cache, entry);
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,34 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+#include "table.h"
+
+// Bytes of compressed selections a table's filter cache keeps at most
+#define FILTER_CACHE_BYTES (64 * 1024 * 1024)
+
+// The selections left by chains of filters, keyed by the normalized text of
+// the chain (see plan.c), so that a script starting with the same filters as
+// an earlier one only evaluates the filters after them. Every script starts
+// from all rows of a table that never changes, so a chain always leaves the
+// same rows. Bitmaps are kept run-length compressed, and the least recently
+// used ones are dropped when the cache is full. Safe to use from several
+// threads at once.
+struct FilterCache;
+typedef struct FilterCache FilterCache;
+
+FilterCache *filter_cache_create(size_t capacity);
+void filter_cache_free(FilterCache *cache);
+
+// Look up the selection a chain of filter_count filters leaves. If it is
+// cached, the bitmap is copied into selection, which must cover the table's
+// rows, counts[i] is set to the rows kept after filter i of the chain, and
+// 1 is returned; otherwise 0. A table without a cache never has a match.
+int filter_cache_get(const Table *table, const char *key, Selection *selection, int *counts, int filter_count);
+
+// Remember the selection a chain of filter_count filters left, with the
+// rows kept after each of them. Does nothing if memory is short.
+void filter_cache_put(const Table *table, const char *key, const Selection *selection, const int *counts, int filter_count);
+
+#endif
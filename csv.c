@@ -0,0 +1,350 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE  // madvise
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "csv.h"
+
+// Read an entire stream into a heap buffer. Used for inputs that cannot be
+// mapped, such as pipes or character devices.
+static int read_whole_file(int fd, MappedFile *file) {
+    size_t capacity = 1 << 16;
+    size_t size = 0;
+    char *data = malloc(capacity);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+
+    for (;;) {
+        if (size == capacity) {
+            char *grown = realloc(data, capacity * 2);
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                free(data);
+                return 0;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + size, capacity - size);
+        if (n < 0) {
+            free(data);
+            return 0;
+        }
+        if (n == 0) break;
+        size += (size_t)n;
+    }
+
+    file->data = data;
+    file->size = size;
+    file->mapped = 0;
+    return 1;
+}
+
+// Function to map a file into memory
+int map_file(const char *path, MappedFile *file) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    // mmap refuses zero-length mappings, so empty files are read like pipes
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            close(fd);
+            file->data = data;
+            file->size = (size_t)st.st_size;
+            file->mapped = 1;
+            return 1;
+        }
+    }
+
+    int ok = read_whole_file(fd, file);
+    close(fd);
+    return ok;
+}
+
+void unmap_file(MappedFile *file) {
+    if (file->mapped) {
+        munmap((void *)file->data, file->size);
+    } else {
+        free((void *)file->data);  // Read into the heap, even if it was empty
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+}
+
+size_t release_file_pages(const MappedFile *file, size_t start, size_t end) {
+    long page = sysconf(_SC_PAGESIZE);
+    if (!file->mapped || page <= 0) {
+        return start;
+    }
+    size_t first = start - start % (size_t)page;
+    size_t last = end - end % (size_t)page;
+    if (last > first) {
+        madvise((char *)file->data + first, last - first, MADV_DONTNEED);
+    }
+    return last > start ? last : start;
+}
+
+// Count newlines in buf[start .. end)
+static int count_newlines(const char *buf, size_t start, size_t end) {
+    int count = 0;
+    const char *p = buf + start;
+    const char *stop = buf + end;
+    while (p < stop && (p = memchr(p, '\n', (size_t)(stop - p))) != NULL) {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+// Function to scan one CSV record in place, recording the field spans. If
+// skip_rest is set, the fields after the first max_fields are stepped over
+// with one search for the end of the line when they hold no quotes.
+static int scan_record(const char *buf, size_t size, size_t *pos, CsvField *fields, int max_fields, int *lines, int skip_rest) {
+    size_t p = *pos;
+    if (p >= size) return -1;
+
+    int field_count = 0;
+    int newlines = 0;
+
+    for (;;) {
+        if (skip_rest && field_count == max_fields) {
+            const char *newline = memchr(buf + p, '\n', size - p);
+            size_t end = newline != NULL ? (size_t)(newline - buf) : size;
+            if (memchr(buf + p, '"', end - p) == NULL) {
+                p = end;
+                break;
+            }
+            skip_rest = 0;  // A quote may hide a newline; split the rest normally
+        }
+
+        size_t start, end;
+        int flags = 0;
+
+        // Skip leading spaces
+        while (p < size && (buf[p] == ' ' || buf[p] == '\t')) p++;
+
+        if (p < size && buf[p] == '"') {
+            // Quoted field: runs to the next quote that is not part of a "" escape
+            flags = CSV_FIELD_QUOTED;
+            start = ++p;
+            for (;;) {
+                const char *quote = memchr(buf + p, '"', size - p);
+                if (quote == NULL) {
+                    // Unterminated quote, take the rest of the buffer
+                    newlines += count_newlines(buf, p, size);
+                    end = p = size;
+                    break;
+                }
+                size_t q = (size_t)(quote - buf);
+                newlines += count_newlines(buf, p, q);
+                if (q + 1 < size && buf[q + 1] == '"') {
+                    flags |= CSV_FIELD_ESCAPED;
+                    p = q + 2;
+                    continue;
+                }
+                end = q;
+                p = q + 1;
+                break;
+            }
+            // Ignore anything between the closing quote and the delimiter
+            while (p < size && buf[p] != ',' && buf[p] != '\n') p++;
+        } else {
+            start = p;
+            while (p < size && buf[p] != ',' && buf[p] != '\n') p++;
+            end = p;
+            // Trim trailing whitespace, including the '\r' of CRLF line endings
+            while (end > start && (buf[end - 1] == ' ' || buf[end - 1] == '\t' || buf[end - 1] == '\r')) end--;
+        }
+
+        if (field_count < max_fields) {
+            fields[field_count].offset = start;
+            fields[field_count].length = end - start;
+            fields[field_count].flags = flags;
+        }
+        field_count++;
+
+        if (p < size && buf[p] == ',') {
+            p++;
+            continue;
+        }
+        break;
+    }
+
+    // Step over the record terminator
+    if (p < size) p++;
+
+    *pos = p;
+    *lines += newlines + 1;
+    return field_count;
+}
+
+int csv_next_record(const char *buf, size_t size, size_t *pos, CsvField *fields, int max_fields, int *lines) {
+    return scan_record(buf, size, pos, fields, max_fields, lines, 0);
+}
+
+int csv_next_record_prefix(const char *buf, size_t size, size_t *pos, CsvField *fields, int max_fields, int *lines) {
+    int field_count = scan_record(buf, size, pos, fields, max_fields, lines, 1);
+    return field_count > max_fields ? max_fields : field_count;
+}
+
+int csv_field_equals(const char *buf, const CsvField *field, const char *str) {
+    if (field->flags & CSV_FIELD_ESCAPED) {
+        // Compare the unescaped value as it is read, whatever its length
+        const char *src = buf + field->offset;
+        for (size_t i = 0; i < field->length; i++, str++) {
+            if (*str != src[i]) return 0;
+            if (src[i] == '"' && i + 1 < field->length && src[i + 1] == '"') i++;
+        }
+        return *str == '\0';
+    }
+    return strlen(str) == field->length && memcmp(buf + field->offset, str, field->length) == 0;
+}
+
+size_t csv_field_copy(const char *buf, const CsvField *field, char *dest, size_t dest_size) {
+    const char *src = buf + field->offset;
+    size_t n = 0;
+
+    if (dest_size == 0) return 0;
+
+    if (field->flags & CSV_FIELD_ESCAPED) {
+        for (size_t i = 0; i < field->length && n + 1 < dest_size; i++) {
+            dest[n++] = src[i];
+            if (src[i] == '"' && i + 1 < field->length && src[i + 1] == '"') i++;
+        }
+    } else {
+        n = field->length < dest_size - 1 ? field->length : dest_size - 1;
+        memcpy(dest, src, n);
+    }
+    dest[n] = '\0';
+    return n;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Slow path: hand a bounded, NUL-terminated copy to strtof
+static int parse_float_slow(const char *str, size_t length, float *value) {
+    char tmp[64];
+    size_t n = length < sizeof(tmp) - 1 ? length : sizeof(tmp) - 1;
+    memcpy(tmp, str, n);
+    tmp[n] = '\0';
+
+    char *end;
+    float parsed = strtof(tmp, &end);
+    if (end == tmp) return 0;
+    *value = parsed;
+    return 1;
+}
+
+// Function to parse a float without copying the field. Plain decimals with at
+// most 7 significant digits and 10 fractional digits are converted exactly with
+// one float division (both operands are exactly representable, so the result is
+// correctly rounded, like strtof). Anything else goes through strtof.
+int csv_parse_float(const char *str, size_t length, float *value) {
+#if FLT_EVAL_METHOD == 0
+    static const float powers_of_ten[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+    size_t i = 0;
+    int negative = 0;
+    unsigned long mantissa = 0;
+    int digits = 0;
+    int fraction_digits = 0;
+
+    while (i < length && is_space(str[i])) i++;
+    if (i < length && (str[i] == '-' || str[i] == '+')) {
+        negative = str[i] == '-';
+        i++;
+    }
+    while (i < length && str[i] >= '0' && str[i] <= '9') {
+        mantissa = mantissa * 10 + (unsigned long)(str[i] - '0');
+        if (mantissa > (1UL << 24)) return parse_float_slow(str, length, value);
+        digits++;
+        i++;
+    }
+    if (i < length && str[i] == '.') {
+        i++;
+        while (i < length && str[i] >= '0' && str[i] <= '9') {
+            mantissa = mantissa * 10 + (unsigned long)(str[i] - '0');
+            if (mantissa > (1UL << 24) || fraction_digits == 10) return parse_float_slow(str, length, value);
+            digits++;
+            fraction_digits++;
+            i++;
+        }
+    }
+    if (digits == 0) return parse_float_slow(str, length, value);
+    if (i < length && (str[i] == 'e' || str[i] == 'E' || str[i] == 'x' || str[i] == 'X')) {
+        return parse_float_slow(str, length, value);
+    }
+
+    float result = (float)mantissa / powers_of_ten[fraction_digits];
+    *value = negative ? -result : result;
+    return 1;
+#else
+    return parse_float_slow(str, length, value);
+#endif
+}
+
+// Function to parse an int the way sscanf("%d") does
+int csv_parse_int(const char *str, size_t length, int *value) {
+    size_t i = 0;
+    int negative = 0;
+    long long result = 0;
+    int digits = 0;
+
+    while (i < length && is_space(str[i])) i++;
+    if (i < length && (str[i] == '-' || str[i] == '+')) {
+        negative = str[i] == '-';
+        i++;
+    }
+    while (i < length && str[i] >= '0' && str[i] <= '9') {
+        if (result < 10000000000LL) {
+            result = result * 10 + (str[i] - '0');
+        }
+        digits++;
+        i++;
+    }
+    if (digits == 0) return 0;
+
+    if (negative) result = -result;
+    if (result > 2147483647LL) result = 2147483647LL;
+    if (result < -2147483647LL - 1) result = -2147483647LL - 1;
+    *value = (int)result;
+    return 1;
+}
+
+int csv_is_int(const char *str, size_t length) {
+    size_t i = 0;
+    while (i < length && is_space(str[i])) i++;
+    if (i < length && (str[i] == '-' || str[i] == '+')) i++;
+    return i < length && str[i] >= '0' && str[i] <= '9';
+}
+
+int csv_is_float(const char *str, size_t length) {
+    size_t i = 0;
+    while (i < length && is_space(str[i])) i++;
+    if (i < length && (str[i] == '-' || str[i] == '+')) i++;
+    if (i + 1 < length && str[i] == '.') i++;
+
+    // A digit within the part of the field strtof is given always parses
+    if (i < length && i < 63 && str[i] >= '0' && str[i] <= '9') {
+        return 1;
+    }
+    float value;
+    return csv_parse_float(str, length, &value);
+}
@@ -0,0 +1,62 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stddef.h>
+
+// Flags describing how a field was written in the file
+#define CSV_FIELD_QUOTED  0x1  // Field was enclosed in double quotes
+#define CSV_FIELD_ESCAPED 0x2  // Quoted field contains "" escapes that need unescaping
+
+// A whole input file held in memory, either memory-mapped or read into a heap buffer
+typedef struct {
+    const char *data;
+    size_t size;
+    int mapped;  // 1 if data points into an mmap'ed region, 0 if it was malloc'ed
+} MappedFile;
+
+// Location of one field inside the input buffer. Nothing is copied: the field
+// contents are data[offset .. offset + length), with quotes already excluded.
+typedef struct {
+    size_t offset;
+    size_t length;
+    int flags;
+} CsvField;
+
+// Map a file into memory (falls back to reading it when mmap is not possible)
+int map_file(const char *path, MappedFile *file);
+void unmap_file(MappedFile *file);
+
+// Drop the whole pages of a mapped file in [start, end) from memory; they are
+// read from the file again if they are touched. Returns the offset up to
+// which pages were dropped, to pass as start next time.
+size_t release_file_pages(const MappedFile *file, size_t start, size_t end);
+
+// Scan the record starting at *pos. Up to max_fields field spans are stored in
+// fields; the return value is the number of fields in the record (which may be
+// larger than max_fields) or -1 when there is no record left. *pos is advanced
+// past the record terminator and *lines is increased by the number of physical
+// lines the record spanned (quoted fields may contain newlines).
+int csv_next_record(const char *buf, size_t size, size_t *pos, CsvField *fields, int max_fields, int *lines);
+
+// Like csv_next_record, but for callers that only need the first max_fields
+// fields: the rest of the record is skipped without being split, and the
+// return value is at most max_fields.
+int csv_next_record_prefix(const char *buf, size_t size, size_t *pos, CsvField *fields, int max_fields, int *lines);
+
+// Compare a field against a NUL-terminated string
+int csv_field_equals(const char *buf, const CsvField *field, const char *str);
+
+// Copy a field into dest (at most dest_size - 1 characters), undoing "" escapes
+size_t csv_field_copy(const char *buf, const CsvField *field, char *dest, size_t dest_size);
+
+// Parse a number from a field. These accept exactly what sscanf("%f") and
+// sscanf("%d") would accept and return 1 on success, 0 otherwise.
+int csv_parse_float(const char *str, size_t length, float *value);
+int csv_parse_int(const char *str, size_t length, int *value);
+
+// Whether csv_parse_int / csv_parse_float would accept the field, without
+// converting it in the common case
+int csv_is_int(const char *str, size_t length);
+int csv_is_float(const char *str, size_t length);
+
+#endif
@@ -0,0 +1,31 @@
+#include "fields.h"
+
+// Global definition of valid fields and their corresponding print formats
+const char *valid_fields[] = {
+    "County", "State", "Education.Bachelor's Degree or Higher", "Education.High School or Higher",
+    "Ethnicities.American Indian and Alaska Native Alone", "Ethnicities.Asian Alone", "Ethnicities.Black Alone",
+    "Ethnicities.Hispanic or Latino", "Ethnicities.Native Hawaiian and Other Pacific Islander Alone",
+    "Ethnicities.Two or More Races", "Ethnicities.White Alone", "Ethnicities.White Alone not Hispanic or Latino",
+    "Income.Median Household Income", "Income.Per Capita Income", "Income.Persons Below Poverty Level", 
+    "Population.2014 Population"
+};
+
+const char *print_formats[] = {
+    "County: %s\n", "State: %s\n", "Education (Bachelor's Degree or Higher): %f%%\n",
+    "Education (High School or Higher): %f%%\n", "Ethnicity (American Indian and Alaska Native Alone): %f%%\n", "Ethnicity (Asian Alone): %f%%\n",
+    "Ethnicity (Black Alone): %f%%\n", "Ethnicity (Hispanic or Latino): %f%%\n", "Ethnicity (Native Hawaiian and Other Pacific Islander Alone: %f%%\n",
+    "Ethnicity (Two or More Races): %f%%\n", "Ethnicity (White Alone): %f%%\n",
+    "Ethnicity (White Alone not Hispanic or Latino): %f%%\n", "Median Household Income: %d\n",
+    "Per Capita Income: %d\n", "Income Below Poverty Level: %f%%\n", "Population 2014: %d\n\n"
+};
+
+const FieldType field_types[] = {
+    FIELD_STRING, FIELD_STRING, FIELD_FLOAT, FIELD_FLOAT,
+    FIELD_FLOAT, FIELD_FLOAT, FIELD_FLOAT,
+    FIELD_FLOAT, FIELD_FLOAT,
+    FIELD_FLOAT, FIELD_FLOAT, FIELD_FLOAT,
+    FIELD_INT, FIELD_INT, FIELD_FLOAT,
+    FIELD_INT
+};
+
+const int valid_fields_count = sizeof(valid_fields) / sizeof(valid_fields[0]);
@@ -0,0 +1,13 @@
+#ifndef FIELDS_H
+#define FIELDS_H
+
+#include "table.h"
+
+// The fields every record must hold, with the formats display prints them
+// with and their types
+extern const char *valid_fields[];
+extern const char *print_formats[];
+extern const FieldType field_types[];
+extern const int valid_fields_count;
+
+#endif
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "group.h"
+#include "index.h"
+
+int group_table_init(GroupTable *groups, const Table *table, int column) {
+    memset(groups, 0, sizeof(*groups));
+    groups->table = table;
+    groups->column = &table->columns[column];
+    groups->dense = groups->column->type == FIELD_STRING;
+    groups->capacity = groups->dense && table->strings.count > 0 ? table->strings.count : 64;
+    groups->groups = calloc(groups->capacity, sizeof(GroupTotals));
+    if (groups->groups == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+void group_table_free(GroupTable *groups) {
+    free(groups->groups);
+    groups->groups = NULL;
+    groups->capacity = groups->count = 0;
+}
+
+uint32_t group_key(const Column *column, int row) {
+    switch (column->type) {
+        case FIELD_STRING:
+            return column->strings[row];
+        case FIELD_FLOAT: {
+            float value = column->floats[row];
+            if (value == 0) value = 0.0f;
+            if (isnan(value)) value = NAN;
+            return index_float_key(value);
+        }
+        default:
+            return index_int_key(column->ints[row]);
+    }
+}
+
+// Function to mix the bits of a key for the hash table
+static uint32_t hash_key(uint32_t key) {
+    key ^= key >> 16;
+    key *= UINT32_C(0x7feb352d);
+    key ^= key >> 15;
+    key *= UINT32_C(0x846ca68b);
+    return key ^ (key >> 16);
+}
+
+// Function to double the hash table, reinserting every group
+static int grow(GroupTable *groups) {
+    uint32_t capacity = groups->capacity * 2;
+    GroupTotals *grown = calloc(capacity, sizeof(GroupTotals));
+    if (grown == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    for (uint32_t i = 0; i < groups->capacity; i++) {
+        if (groups->groups[i].rows == 0) continue;
+        uint32_t slot = hash_key(groups->groups[i].key) & (capacity - 1);
+        while (grown[slot].rows != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        grown[slot] = groups->groups[i];
+    }
+    free(groups->groups);
+    groups->groups = grown;
+    groups->capacity = capacity;
+    return 1;
+}
+
+// Function to make room in a dense table for string ids up to key
+static int grow_dense(GroupTable *groups, uint32_t key) {
+    uint32_t capacity = groups->capacity * 2 > key ? groups->capacity * 2 : key + 1;
+    GroupTotals *grown = realloc(groups->groups, capacity * sizeof(GroupTotals));
+    if (grown == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    memset(grown + groups->capacity, 0, (capacity - groups->capacity) * sizeof(GroupTotals));
+    groups->groups = grown;
+    groups->capacity = capacity;
+    return 1;
+}
+
+GroupTotals *group_table_find(GroupTable *groups, uint32_t key, int row) {
+    GroupTotals *group;
+    if (groups->dense) {
+        if (key >= groups->capacity && !grow_dense(groups, key)) {
+            return NULL;
+        }
+        group = &groups->groups[key];
+    } else {
+        // Keep the table at most half full
+        if ((groups->count + 1) * 2 > groups->capacity && !grow(groups)) {
+            return NULL;
+        }
+        uint32_t slot = hash_key(key) & (groups->capacity - 1);
+        while (groups->groups[slot].rows != 0 && groups->groups[slot].key != key) {
+            slot = (slot + 1) & (groups->capacity - 1);
+        }
+        group = &groups->groups[slot];
+    }
+    if (group->rows == 0) {
+        group->key = key;
+        group->first_value = ((const uint32_t *)column_data(groups->column))[row];
+        groups->count++;
+    }
+    return group;
+}
+
+// A group and the string it is sorted by
+typedef struct {
+    const char *text;
+    GroupTotals *group;
+} NamedGroup;
+
+static int compare_named(const void *a, const void *b) {
+    return strcmp(((const NamedGroup *)a)->text, ((const NamedGroup *)b)->text);
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint32_t x = (*(GroupTotals *const *)a)->key, y = (*(GroupTotals *const *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+GroupTotals **group_table_sorted(const GroupTable *groups) {
+    GroupTotals **sorted = malloc((groups->count > 0 ? groups->count : 1) * sizeof(GroupTotals *));
+    NamedGroup *named = groups->dense ? malloc((groups->count > 0 ? groups->count : 1) * sizeof(NamedGroup)) : NULL;
+    if (sorted == NULL || (groups->dense && named == NULL)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(sorted);
+        free(named);
+        return NULL;
+    }
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < groups->capacity; i++) {
+        if (groups->groups[i].rows == 0) continue;
+        if (groups->dense) {
+            named[count].text = string_pool_get(&groups->table->strings, groups->groups[i].key);
+            named[count].group = &groups->groups[i];
+        }
+        sorted[count++] = &groups->groups[i];
+    }
+    if (groups->dense) {
+        qsort(named, count, sizeof(NamedGroup), compare_named);
+        for (uint32_t i = 0; i < count; i++) {
+            sorted[i] = named[i].group;
+        }
+        free(named);
+    } else {
+        qsort(sorted, count, sizeof(GroupTotals *), compare_keys);
+    }
+    return sorted;
+}
+
+void group_format_key(const GroupTable *groups, const GroupTotals *group, char *buffer, size_t size) {
+    switch (groups->column->type) {
+        case FIELD_STRING:
+            snprintf(buffer, size, "%s", string_pool_get(&groups->table->strings, group->key));
+            break;
+        case FIELD_FLOAT: {
+            float value;
+            memcpy(&value, &group->first_value, sizeof(value));
+            snprintf(buffer, size, "%f", value);
+            break;
+        }
+        case FIELD_INT:
+            snprintf(buffer, size, "%d", (int)group->first_value);
+            break;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <stdint.h>
+
+#include "table.h"
+#include "kernels.h"
+
+// Running totals of one group
+typedef struct {
+    uint32_t key;         // Group key, see group_key
+    uint32_t first_value; // Value of the first row seen in the group, to print the key from
+    int rows;             // Rows added to the group; 0 marks an unused slot
+    int64_t population;
+    CompensatedSum sub;   // Sum of the group's block sums, in block order
+    double block_sub;     // Sum over the group's rows of the current block
+    uint32_t block;       // Block block_sub is for (see GroupTable)
+    uint32_t word;        // Word of rows the group was last seen in (see GroupTable)
+    int slot;             // Position of the group among that word's groups
+} GroupTotals;
+
+// Totals per distinct value of a key column. Groups of a string column live
+// in a dense array indexed by string id, which grows as strings are added to
+// the table; groups of a numeric column live in an open-addressing hash
+// table keyed by value.
+typedef struct {
+    const Table *table;
+    const Column *column;
+    GroupTotals *groups;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t words;  // Words of rows added so far, numbering them for GroupTotals.word
+    uint32_t blocks; // Blocks of rows started so far, numbering them for GroupTotals.block
+    int dense;
+} GroupTable;
+
+int group_table_init(GroupTable *groups, const Table *table, int column);
+void group_table_free(GroupTable *groups);
+
+// Key of a row: the string id, or an order-preserving key for numbers in
+// which every zero and every NaN are the same
+uint32_t group_key(const Column *column, int row);
+
+// Find the totals for a key, creating the group for row if it is new.
+// Returns NULL if memory ran out. Pointers to groups are only valid until
+// the next call.
+GroupTotals *group_table_find(GroupTable *groups, uint32_t key, int row);
+
+// List the groups in key order (strings alphabetically, numbers by value).
+// Returns a malloc'd array of group_count pointers, or NULL.
+GroupTotals **group_table_sorted(const GroupTable *groups);
+
+// Write the key of a group as text
+void group_format_key(const GroupTable *groups, const GroupTotals *group, char *buffer, size_t size);
+
+#endif
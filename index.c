@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "index.h"
+
+struct TableIndex {
+    pthread_mutex_t lock;
+    int column_count;
+    ColumnIndex *columns;  // rows is NULL until the column's index is built
+    int *uses;             // Filters that have asked for each column's index
+    ColumnStats *stats;    // Statistics of each column, once gathered
+    unsigned char *has_stats;
+};
+
+TableIndex *table_index_create(int column_count) {
+    TableIndex *index = malloc(sizeof(TableIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->columns = calloc(column_count > 0 ? column_count : 1, sizeof(ColumnIndex));
+    index->uses = calloc(column_count > 0 ? column_count : 1, sizeof(int));
+    index->stats = calloc(column_count > 0 ? column_count : 1, sizeof(ColumnStats));
+    index->has_stats = calloc(column_count > 0 ? column_count : 1, 1);
+    if (index->columns == NULL || index->uses == NULL || index->stats == NULL || index->has_stats == NULL) {
+        free(index->columns);
+        free(index->uses);
+        free(index->stats);
+        free(index->has_stats);
+        free(index);
+        return NULL;
+    }
+    index->column_count = column_count;
+    pthread_mutex_init(&index->lock, NULL);
+    return index;
+}
+
+void table_index_free(TableIndex *index) {
+    if (index == NULL) return;
+    for (int i = 0; i < index->column_count; i++) {
+        free(index->columns[i].offsets);
+        free(index->columns[i].rows);
+    }
+    free(index->columns);
+    free(index->uses);
+    free(index->stats);
+    free(index->has_stats);
+    pthread_mutex_destroy(&index->lock);
+    free(index);
+}
+
+// Function to group the rows of a string column by string id (a counting sort)
+static int build_postings(ColumnIndex *index, const Table *table, const Column *column) {
+    uint32_t string_count = table->strings.count;
+    uint32_t *offsets = calloc(string_count + 1, sizeof(uint32_t));
+    uint32_t *next = malloc(string_count * sizeof(uint32_t));
+    uint32_t *rows = malloc((table->row_count > 0 ? table->row_count : 1) * sizeof(uint32_t));
+    int ok = offsets != NULL && next != NULL && rows != NULL;
+
+    for (int row = 0; ok && row < table->row_count; row++) {
+        if (column->strings[row] >= string_count) {
+            ok = 0;  // Not an id of this table's pool
+        } else {
+            offsets[column->strings[row] + 1]++;
+        }
+    }
+    if (ok) {
+        for (uint32_t id = 0; id < string_count; id++) {
+            offsets[id + 1] += offsets[id];
+            next[id] = offsets[id];
+        }
+        for (int row = 0; row < table->row_count; row++) {
+            rows[next[column->strings[row]]++] = row;
+        }
+        index->offsets = offsets;
+        index->rows = rows;
+    } else {
+        free(offsets);
+        free(rows);
+    }
+    free(next);
+    return ok;
+}
+
+// Function to order the rows of a numeric column by value. A stable
+// least-significant-digit radix sort on the value keys, one byte per pass;
+// passes in which every key has the same digit are skipped.
+static int build_sorted(ColumnIndex *index, const Column *column, int row_count) {
+    size_t size = (row_count > 0 ? row_count : 1) * sizeof(uint32_t);
+    uint32_t *keys = malloc(size), *next_keys = malloc(size);
+    uint32_t *rows = malloc(size), *next_rows = malloc(size);
+    if (keys == NULL || next_keys == NULL || rows == NULL || next_rows == NULL) {
+        free(keys);
+        free(next_keys);
+        free(rows);
+        free(next_rows);
+        return 0;
+    }
+
+    for (int row = 0; row < row_count; row++) {
+        keys[row] = column->type == FIELD_FLOAT ? index_float_key(column->floats[row]) : index_int_key(column->ints[row]);
+        rows[row] = row;
+    }
+
+    for (int shift = 0; shift < 32 && row_count > 0; shift += 8) {
+        int counts[257] = {0};
+        for (int i = 0; i < row_count; i++) {
+            counts[((keys[i] >> shift) & 0xff) + 1]++;
+        }
+        if (counts[((keys[0] >> shift) & 0xff) + 1] == row_count) {
+            continue;
+        }
+        for (int digit = 0; digit < 256; digit++) {
+            counts[digit + 1] += counts[digit];
+        }
+        for (int i = 0; i < row_count; i++) {
+            int position = counts[(keys[i] >> shift) & 0xff]++;
+            next_keys[position] = keys[i];
+            next_rows[position] = rows[i];
+        }
+        uint32_t *swap = keys; keys = next_keys; next_keys = swap;
+        swap = rows; rows = next_rows; next_rows = swap;
+    }
+
+    free(keys);
+    free(next_keys);
+    free(next_rows);
+    index->rows = rows;
+    return 1;
+}
+
+const ColumnIndex *column_index(const Table *table, int column) {
+    TableIndex *indexes = table->index;
+    if (indexes == NULL || column < 0 || column >= indexes->column_count) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&indexes->lock);
+    ColumnIndex *index = &indexes->columns[column];
+    const Column *data = &table->columns[column];
+    int uses = ++indexes->uses[column];
+    if (index->rows == NULL && (data->type == FIELD_STRING || uses >= 2)) {
+        int ok = data->type == FIELD_STRING ? build_postings(index, table, data) : build_sorted(index, data, table->row_count);
+        if (!ok) {
+            fprintf(stderr, "Memory allocation failed\n");
+        }
+    }
+    const ColumnIndex *built = index->rows != NULL ? index : NULL;
+    pthread_mutex_unlock(&indexes->lock);
+    return built;
+}
+
+// Function to gather the range and the histogram of a numeric column: one
+// pass for the range, one to count the rows of each bucket
+static void build_stats(ColumnStats *stats, const Column *column, int row_count) {
+    memset(stats, 0, sizeof(*stats));
+    for (int row = 0; row < row_count; row++) {
+        double value = column_value(column, row);
+        if (isnan(value)) continue;
+        if (stats->values == 0 || value < stats->min) stats->min = value;
+        if (stats->values == 0 || value > stats->max) stats->max = value;
+        stats->values++;
+    }
+    double width = (stats->max - stats->min) / HISTOGRAM_BUCKETS;
+    for (int row = 0; row < row_count && stats->values > 0; row++) {
+        double value = column_value(column, row);
+        if (isnan(value)) continue;
+        int bucket = width > 0 && isfinite(width) ? (int)((value - stats->min) / width) : 0;
+        stats->buckets[bucket < 0 ? 0 : bucket >= HISTOGRAM_BUCKETS ? HISTOGRAM_BUCKETS - 1 : bucket]++;
+    }
+}
+
+const ColumnStats *column_stats(const Table *table, int column) {
+    TableIndex *indexes = table->index;
+    if (indexes == NULL || column < 0 || column >= indexes->column_count
+        || table->columns[column].type == FIELD_STRING || column_data(&table->columns[column]) == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&indexes->lock);
+    if (!indexes->has_stats[column]) {
+        build_stats(&indexes->stats[column], &table->columns[column], table->row_count);
+        indexes->has_stats[column] = 1;
+    }
+    pthread_mutex_unlock(&indexes->lock);
+    return &indexes->stats[column];
+}
+
+double stats_share(const ColumnStats *stats, int row_count, double low, double high) {
+    if (row_count <= 0 || stats->values == 0 || low > high || high < stats->min || low > stats->max) {
+        return 0.0;
+    }
+    double width = (stats->max - stats->min) / HISTOGRAM_BUCKETS;
+    if (!(width > 0) || !isfinite(width)) {
+        return (double)stats->values / row_count;  // Every value is in [low, high]
+    }
+
+    // Whole buckets count fully, the ones [low, high] cuts count in
+    // proportion; a single value takes the share of its bucket
+    double rows = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        double start = stats->min + i * width, end = start + width;
+        if (high < start || low > end) continue;
+        double covered = ((high < end ? high : end) - (low > start ? low : start)) / width;
+        rows += stats->buckets[i] * (low == high ? 1.0 : covered);
+        if (low == high) break;
+    }
+    return rows / row_count;
+}
+
+int index_string_rows(const Table *table, const ColumnIndex *index, uint32_t id, const uint32_t **rows) {
+    if (id >= table->strings.count) {
+        *rows = index->rows;
+        return 0;
+    }
+    *rows = index->rows + index->offsets[id];
+    return (int)(index->offsets[id + 1] - index->offsets[id]);
+}
+
+// Key of the value of a row of a numeric column
+static uint32_t row_key(const Column *column, uint32_t row) {
+    return column->type == FIELD_FLOAT ? index_float_key(column->floats[row]) : index_int_key(column->ints[row]);
+}
+
+// Function to find the first position in the sorted rows whose key is at
+// least key (or greater than key if after is set)
+static int search_key(const ColumnIndex *index, const Column *column, int row_count, uint32_t key, int after) {
+    int low = 0, high = row_count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        uint32_t value = row_key(column, index->rows[middle]);
+        if (value < key || (after && value == key)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int index_key_rows(const ColumnIndex *index, const Column *column, int row_count, uint32_t low, uint32_t high, const uint32_t **rows) {
+    int first = search_key(index, column, row_count, low, 0);
+    int last = search_key(index, column, row_count, high, 1);
+    *rows = index->rows + first;
+    return last > first ? last - first : 0;
+}
@@ -0,0 +1,73 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "table.h"
+
+// Secondary index over one column.
+// String columns: the rows holding string id s are rows[offsets[s]] up to
+// rows[offsets[s + 1]], in ascending order.
+// Numeric columns: rows holds every row ordered by value, with equal values
+// in row order, and offsets is NULL.
+typedef struct {
+    uint32_t *offsets;
+    uint32_t *rows;
+} ColumnIndex;
+
+// Number of equal-width ranges a column's histogram has
+#define HISTOGRAM_BUCKETS 64
+
+// Distribution of the values of a numeric column, used to estimate how many
+// rows a comparison keeps
+typedef struct {
+    int values;        // Rows whose value is not NaN
+    double min;        // Smallest and largest value that is not NaN
+    double max;
+    int buckets[HISTOGRAM_BUCKETS];  // Rows in each equal part of [min, max]
+} ColumnStats;
+
+// The indexes of a table, built as filters ask for them
+struct TableIndex;
+typedef struct TableIndex TableIndex;
+
+TableIndex *table_index_create(int column_count);
+void table_index_free(TableIndex *index);
+
+// Return the index of a column for a filter about to run on it, or NULL if
+// there is none. String columns are indexed the first time they are filtered.
+// Sorting a numeric column costs a few scans of it, so its index is only
+// built the second time the column is filtered. Safe to call from several
+// threads at once.
+const ColumnIndex *column_index(const Table *table, int column);
+
+// Return the statistics of a numeric column, gathered in one scan the first
+// time they are asked for, or NULL if the column has none. Safe to call from
+// several threads at once.
+const ColumnStats *column_stats(const Table *table, int column);
+
+// Estimated share of all row_count rows whose value lies in [low, high]
+double stats_share(const ColumnStats *stats, int row_count, double low, double high);
+
+// Rows of a string column holding the given string id. Returns the number of rows.
+int index_string_rows(const Table *table, const ColumnIndex *index, uint32_t id, const uint32_t **rows);
+
+// Rows of a numeric column whose value key lies in [low, high] (see
+// index_float_key and index_int_key). Returns the number of rows; they are
+// ordered by value, not by row.
+int index_key_rows(const ColumnIndex *index, const Column *column, int row_count, uint32_t low, uint32_t high, const uint32_t **rows);
+
+// Keys that order values like the values themselves (-0.0 before 0.0, NaNs
+// beyond the infinities)
+static inline uint32_t index_float_key(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & UINT32_C(0x80000000)) ? ~bits : bits | UINT32_C(0x80000000);
+}
+
+static inline uint32_t index_int_key(int value) {
+    return (uint32_t)value ^ UINT32_C(0x80000000);
+}
+
+#endif
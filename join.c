@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "join.h"
+#include "index.h"
+
+// Distinct keys of the rows on the build side of a join, in an open
+// addressing hash table. Sized for every build row, so it never grows.
+typedef struct {
+    uint32_t *slots;  // entry + 1, or 0 for an empty slot
+    uint32_t mask;
+    uint32_t *keys;   // key_count keys per entry
+    uint32_t *rows;   // First build row holding each entry's key
+    int count;
+    int key_count;
+} KeyTable;
+
+// Function to mix the bits of a key for the hash table
+static uint32_t hash_key(uint32_t key) {
+    key ^= key >> 16;
+    key *= UINT32_C(0x7feb352d);
+    key ^= key >> 15;
+    key *= UINT32_C(0x846ca68b);
+    return key ^ (key >> 16);
+}
+
+static int key_table_init(KeyTable *keys, int row_count, int key_count) {
+    uint32_t slot_count = 16;
+    while (slot_count < 2 * (uint32_t)row_count) slot_count *= 2;
+    keys->slots = calloc(slot_count, sizeof(uint32_t));
+    keys->keys = malloc((size_t)(row_count > 0 ? row_count : 1) * key_count * sizeof(uint32_t));
+    keys->rows = malloc((size_t)(row_count > 0 ? row_count : 1) * sizeof(uint32_t));
+    keys->mask = slot_count - 1;
+    keys->count = 0;
+    keys->key_count = key_count;
+    if (keys->slots == NULL || keys->keys == NULL || keys->rows == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+static void key_table_free(KeyTable *keys) {
+    free(keys->slots);
+    free(keys->keys);
+    free(keys->rows);
+}
+
+// Function to find the entry holding key; with row >= 0 a missing key is
+// added with that row. Returns the entry, or -1 if the key is absent.
+static int key_table_find(KeyTable *keys, const uint32_t *key, int row) {
+    uint32_t hash = 0;
+    for (int k = 0; k < keys->key_count; k++) hash = hash_key(hash ^ key[k]);
+    for (uint32_t slot = hash & keys->mask;; slot = (slot + 1) & keys->mask) {
+        uint32_t entry = keys->slots[slot];
+        if (entry == 0) break;
+        if (memcmp(keys->keys + (size_t)(entry - 1) * keys->key_count, key, keys->key_count * sizeof(uint32_t)) == 0) {
+            return (int)entry - 1;
+        }
+    }
+    if (row < 0) return -1;
+
+    int entry = keys->count++;
+    memcpy(keys->keys + (size_t)entry * keys->key_count, key, keys->key_count * sizeof(uint32_t));
+    keys->rows[entry] = (uint32_t)row;
+    uint32_t slot = hash & keys->mask;
+    while (keys->slots[slot] != 0) slot = (slot + 1) & keys->mask;
+    keys->slots[slot] = (uint32_t)entry + 1;
+    return entry;
+}
+
+// Function to read the key of a row into key. Strings are compared as ids
+// of one table's pool: the row's own ids, its ids mapped through strings,
+// or, if pool is not NULL, the ids its strings have in pool. Returns 0 if
+// the row can never match: a key is NaN, or a string the other table does
+// not hold.
+static int row_key(const Table *table, const int *columns, int key_count, int row, const uint32_t *strings,
+                   const StringPool *pool, uint32_t *key) {
+    for (int k = 0; k < key_count; k++) {
+        const Column *column = &table->columns[columns[k]];
+        switch (column->type) {
+            case FIELD_STRING: {
+                uint32_t id = column->strings[row];
+                if (strings != NULL) {
+                    key[k] = strings[id];
+                } else if (pool != NULL) {
+                    key[k] = string_pool_find(pool, table->strings.strings[id], table->strings.lengths[id]);
+                } else {
+                    key[k] = id;
+                }
+                if (key[k] == STRING_POOL_NONE) return 0;
+                break;
+            }
+            case FIELD_FLOAT: {
+                float value = column->floats[row];
+                if (isnan(value)) return 0;
+                key[k] = index_float_key(value == 0.0f ? 0.0f : value);
+                break;
+            }
+            default:
+                key[k] = index_int_key(column->ints[row]);
+                break;
+        }
+    }
+    return 1;
+}
+
+// Function to build the hash table over the selected rows of table, probe it
+// with the rows of other in row order and give every row holding a key the
+// first row of other that holds it. Rows of table sharing a key are chained
+// through next from the entry's first row. Strings compare as ids of other's
+// pool, looked up for the selected rows only.
+static int join_from_table(const Table *table, const Selection *selection, const int *keys, const Table *other,
+                           const int *other_keys, int key_count, uint32_t *matches) {
+    KeyTable table_keys;
+    uint32_t *next = malloc((size_t)(table->row_count > 0 ? table->row_count : 1) * sizeof(uint32_t));
+    uint32_t *last = malloc((size_t)(selection->count > 0 ? selection->count : 1) * sizeof(uint32_t));
+    unsigned char *matched = calloc(selection->count > 0 ? selection->count : 1, 1);
+    if (!key_table_init(&table_keys, selection->count, key_count) || next == NULL || last == NULL || matched == NULL) {
+        if (next == NULL || last == NULL || matched == NULL) fprintf(stderr, "Memory allocation failed\n");
+        key_table_free(&table_keys);
+        free(next);
+        free(last);
+        free(matched);
+        return 0;
+    }
+
+    uint32_t key[MAX_JOIN_KEYS];
+    for (int row = selection_next(selection, 0); row >= 0; row = selection_next(selection, row + 1)) {
+        next[row] = JOIN_NONE;
+        if (!row_key(table, keys, key_count, row, NULL, &other->strings, key)) continue;
+        int count = table_keys.count;
+        int entry = key_table_find(&table_keys, key, row);
+        if (entry < count) next[last[entry]] = (uint32_t)row;
+        last[entry] = (uint32_t)row;
+    }
+
+    int unmatched = table_keys.count;
+    for (int row = 0; row < other->row_count && unmatched > 0; row++) {
+        if (!row_key(other, other_keys, key_count, row, NULL, NULL, key)) continue;
+        int entry = key_table_find(&table_keys, key, -1);
+        if (entry < 0 || matched[entry]) continue;
+        matched[entry] = 1;
+        unmatched--;
+        for (uint32_t match = table_keys.rows[entry]; match != JOIN_NONE; match = next[match]) {
+            matches[match] = (uint32_t)row;
+        }
+    }
+
+    key_table_free(&table_keys);
+    free(next);
+    free(last);
+    free(matched);
+    return 1;
+}
+
+// Function to build the hash table over the rows of other, keeping the
+// first row of each key, and probe it with the selected rows of table.
+// Strings compare as ids of table's pool, mapped once for every string of
+// other's pool that a key column holds.
+static int join_from_other(const Table *table, const Selection *selection, const int *keys, const Table *other,
+                           const int *other_keys, int key_count, uint32_t *matches) {
+    KeyTable other_keys_table;
+    uint32_t *strings = NULL;
+    for (int k = 0; k < key_count && strings == NULL; k++) {
+        if (other->columns[other_keys[k]].type == FIELD_STRING) {
+            strings = malloc((other->strings.count > 0 ? other->strings.count : 1) * sizeof(uint32_t));
+            if (strings == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                return 0;
+            }
+            for (uint32_t id = 0; id < other->strings.count; id++) {
+                strings[id] = string_pool_find(&table->strings, other->strings.strings[id], other->strings.lengths[id]);
+            }
+        }
+    }
+    if (!key_table_init(&other_keys_table, other->row_count, key_count)) {
+        key_table_free(&other_keys_table);
+        free(strings);
+        return 0;
+    }
+
+    uint32_t key[MAX_JOIN_KEYS];
+    for (int row = 0; row < other->row_count; row++) {
+        if (row_key(other, other_keys, key_count, row, strings, NULL, key)) {
+            key_table_find(&other_keys_table, key, row);
+        }
+    }
+    for (int row = selection_next(selection, 0); row >= 0; row = selection_next(selection, row + 1)) {
+        if (!row_key(table, keys, key_count, row, NULL, NULL, key)) continue;
+        int entry = key_table_find(&other_keys_table, key, -1);
+        if (entry >= 0) matches[row] = other_keys_table.rows[entry];
+    }
+
+    key_table_free(&other_keys_table);
+    free(strings);
+    return 1;
+}
+
+int join_rows(const Table *table, Selection *selection, const int *keys, const Table *other, const int *other_keys,
+              int key_count, uint32_t *matches) {
+    for (int row = 0; row < table->row_count; row++) matches[row] = JOIN_NONE;
+
+    // Strings compare as ids of one pool, so keys compare as numbers
+    int joined = selection->count <= other->row_count
+                     ? join_from_table(table, selection, keys, other, other_keys, key_count, matches)
+                     : join_from_other(table, selection, keys, other, other_keys, key_count, matches);
+    if (!joined) return -1;
+
+    // Keep only the rows that matched
+    int count = 0;
+    int words = SELECTION_WORDS(selection->row_count);
+    for (int w = 0; w < words; w++) {
+        uint64_t bits = selection->bits[w];
+        for (uint64_t left = bits; left != 0; left &= left - 1) {
+            int bit = __builtin_ctzll(left);
+            if (matches[w * 64 + bit] == JOIN_NONE) bits &= ~(UINT64_C(1) << bit);
+        }
+        selection->bits[w] = bits;
+        count += __builtin_popcountll(bits);
+    }
+    selection->count = count;
+    return count;
+}
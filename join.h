@@ -0,0 +1,27 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <stdint.h>
+
+#include "table.h"
+
+// Marks a row that matched no row of the other table
+#define JOIN_NONE UINT32_MAX
+
+// Most key columns a join can match on
+#define MAX_JOIN_KEYS 4
+
+// Match the selected rows of table to the rows of other whose key columns
+// hold the same values: column keys[k] of table against other_keys[k] of
+// other, which must have the same types. Strings compare by content, NaNs
+// never match and 0.0 matches -0.0. A hash table is built over the keys of
+// whichever side has fewer rows and probed with the other.
+// matches[row] is set to the first matching row of other, in row order, or
+// to JOIN_NONE, for every row of table; together the two are the row-id
+// pairs the joined columns are read through. Rows that matched nothing are
+// dropped from the selection. Returns the number of rows kept, or -1 if
+// memory ran out.
+int join_rows(const Table *table, Selection *selection, const int *keys, const Table *other, const int *other_keys,
+              int key_count, uint32_t *matches);
+
+#endif
@@ -0,0 +1,377 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Scalar kernels, used when no vector instruction set is available and for
+// the rows left over after the last full vector
+
+static uint64_t scalar_float_ge(const void *values, int rows, const KernelArg *arg) {
+    const float *v = values;
+    uint64_t result = 0;
+    for (int i = 0; i < rows; i++) {
+        result |= (uint64_t)(v[i] >= arg->f) << i;
+    }
+    return result;
+}
+
+static uint64_t scalar_float_le(const void *values, int rows, const KernelArg *arg) {
+    const float *v = values;
+    uint64_t result = 0;
+    for (int i = 0; i < rows; i++) {
+        result |= (uint64_t)(v[i] <= arg->f) << i;
+    }
+    return result;
+}
+
+static uint64_t scalar_int_gt(const void *values, int rows, const KernelArg *arg) {
+    const int *v = values;
+    uint64_t result = 0;
+    for (int i = 0; i < rows; i++) {
+        result |= (uint64_t)(v[i] > arg->i) << i;
+    }
+    return result;
+}
+
+static uint64_t scalar_int_le(const void *values, int rows, const KernelArg *arg) {
+    const int *v = values;
+    uint64_t result = 0;
+    for (int i = 0; i < rows; i++) {
+        result |= (uint64_t)(v[i] <= arg->i) << i;
+    }
+    return result;
+}
+
+static int64_t scalar_sum_int(const int *values, uint64_t mask, int rows) {
+    int64_t sum = 0;
+    (void)rows;
+    for (; mask != 0; mask &= mask - 1) {
+        sum += values[__builtin_ctzll(mask)];
+    }
+    return sum;
+}
+
+// Add the selected rows from first on to the four accumulators. Rows whose
+// sub-population is NaN (an unreadable percentage) add nothing.
+static void scalar_sub_population_lanes(const float *percentages, const int *population, uint64_t mask, int first, double *lanes) {
+    mask &= ~rows_mask(first);
+    for (; mask != 0; mask &= mask - 1) {
+        int row = __builtin_ctzll(mask);
+        double sub = (percentages[row] / 100.0) * population[row];
+        if (!isnan(sub)) {
+            lanes[row & 3] += sub;
+        }
+    }
+}
+
+static double scalar_sum_sub_population(const float *percentages, const int *population, uint64_t mask, int rows) {
+    double lanes[4] = { 0.0, 0.0, 0.0, 0.0 };
+    (void)rows;
+    scalar_sub_population_lanes(percentages, population, mask, 0, lanes);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static uint64_t match_none(const void *values, int rows, const KernelArg *arg) {
+    (void)values;
+    (void)rows;
+    (void)arg;
+    return 0;
+}
+
+static uint64_t match_all(const void *values, int rows, const KernelArg *arg) {
+    (void)values;
+    (void)arg;
+    return rows_mask(rows);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// Lane masks for 2 and 4 doubles, indexed by the row bits they cover
+static const int64_t lane_masks2[4][2] = {
+    { 0, 0 }, { -1, 0 }, { 0, -1 }, { -1, -1 }
+};
+static const int64_t lane_masks4[16][4] = {
+    { 0, 0, 0, 0 }, { -1, 0, 0, 0 }, { 0, -1, 0, 0 }, { -1, -1, 0, 0 },
+    { 0, 0, -1, 0 }, { -1, 0, -1, 0 }, { 0, -1, -1, 0 }, { -1, -1, -1, 0 },
+    { 0, 0, 0, -1 }, { -1, 0, 0, -1 }, { 0, -1, 0, -1 }, { -1, -1, 0, -1 },
+    { 0, 0, -1, -1 }, { -1, 0, -1, -1 }, { 0, -1, -1, -1 }, { -1, -1, -1, -1 }
+};
+
+// SSE2 kernels: 4 values per compare, 2 doubles per accumulator
+
+TARGET("sse2") static uint64_t sse2_float_ge(const void *values, int rows, const KernelArg *arg) {
+    const float *v = values;
+    __m128 threshold = _mm_set1_ps(arg->f);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        result |= (uint64_t)_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(v + i), threshold)) << i;
+    }
+    return i == rows ? result : result | (scalar_float_ge(v + i, rows - i, arg) << i);
+}
+
+TARGET("sse2") static uint64_t sse2_float_le(const void *values, int rows, const KernelArg *arg) {
+    const float *v = values;
+    __m128 threshold = _mm_set1_ps(arg->f);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        result |= (uint64_t)_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(v + i), threshold)) << i;
+    }
+    return i == rows ? result : result | (scalar_float_le(v + i, rows - i, arg) << i);
+}
+
+TARGET("sse2") static uint64_t sse2_int_gt(const void *values, int rows, const KernelArg *arg) {
+    const int *v = values;
+    __m128i threshold = _mm_set1_epi32(arg->i);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m128i greater = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(v + i)), threshold);
+        result |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(greater)) << i;
+    }
+    return i == rows ? result : result | (scalar_int_gt(v + i, rows - i, arg) << i);
+}
+
+TARGET("sse2") static uint64_t sse2_int_le(const void *values, int rows, const KernelArg *arg) {
+    const int *v = values;
+    __m128i threshold = _mm_set1_epi32(arg->i);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m128i greater = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(v + i)), threshold);
+        result |= (uint64_t)(~_mm_movemask_ps(_mm_castsi128_ps(greater)) & 0xf) << i;
+    }
+    return i == rows ? result : result | (scalar_int_le(v + i, rows - i, arg) << i);
+}
+
+TARGET("sse2") static int64_t sse2_sum_int(const int *values, uint64_t mask, int rows) {
+    __m128i sum = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        int bits = (int)((mask >> i) & 0xf);
+        if (bits == 0) continue;
+        __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128i sign = _mm_srai_epi32(v, 31);
+        __m128i lo = _mm_unpacklo_epi32(v, sign);  // Sign-extend to 64 bits
+        __m128i hi = _mm_unpackhi_epi32(v, sign);
+        lo = _mm_and_si128(lo, _mm_loadu_si128((const __m128i *)lane_masks2[bits & 3]));
+        hi = _mm_and_si128(hi, _mm_loadu_si128((const __m128i *)lane_masks2[bits >> 2]));
+        sum = _mm_add_epi64(sum, _mm_add_epi64(lo, hi));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    return lanes[0] + lanes[1] + scalar_sum_int(values, mask & ~rows_mask(i), rows);
+}
+
+TARGET("sse2") static double sse2_sum_sub_population(const float *percentages, const int *population, uint64_t mask, int rows) {
+    const __m128d hundred = _mm_set1_pd(100.0);
+    __m128d sum01 = _mm_setzero_pd();  // Accumulators 0 and 1
+    __m128d sum23 = _mm_setzero_pd();  // Accumulators 2 and 3
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        int bits = (int)((mask >> i) & 0xf);
+        if (bits == 0) continue;
+        __m128 pct = _mm_loadu_ps(percentages + i);
+        __m128i pop = _mm_loadu_si128((const __m128i *)(population + i));
+        __m128d lo = _mm_mul_pd(_mm_div_pd(_mm_cvtps_pd(pct), hundred), _mm_cvtepi32_pd(pop));
+        __m128d hi = _mm_mul_pd(_mm_div_pd(_mm_cvtps_pd(_mm_movehl_ps(pct, pct)), hundred),
+                                _mm_cvtepi32_pd(_mm_shuffle_epi32(pop, 0xee)));
+        lo = _mm_and_pd(lo, _mm_cmpord_pd(lo, lo));  // NaNs add nothing
+        hi = _mm_and_pd(hi, _mm_cmpord_pd(hi, hi));
+        sum01 = _mm_add_pd(sum01, _mm_and_pd(lo, _mm_loadu_pd((const double *)lane_masks2[bits & 3])));
+        sum23 = _mm_add_pd(sum23, _mm_and_pd(hi, _mm_loadu_pd((const double *)lane_masks2[bits >> 2])));
+    }
+    double lanes[4];
+    _mm_storeu_pd(lanes, sum01);
+    _mm_storeu_pd(lanes + 2, sum23);
+    scalar_sub_population_lanes(percentages, population, mask, i, lanes);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// AVX2 kernels: 8 values per compare, 4 doubles per accumulator
+
+TARGET("avx2") static uint64_t avx2_float_ge(const void *values, int rows, const KernelArg *arg) {
+    const float *v = values;
+    __m256 threshold = _mm256_set1_ps(arg->f);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        result |= (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + i), threshold, _CMP_GE_OQ)) << i;
+    }
+    return i == rows ? result : result | (scalar_float_ge(v + i, rows - i, arg) << i);
+}
+
+TARGET("avx2") static uint64_t avx2_float_le(const void *values, int rows, const KernelArg *arg) {
+    const float *v = values;
+    __m256 threshold = _mm256_set1_ps(arg->f);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        result |= (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + i), threshold, _CMP_LE_OQ)) << i;
+    }
+    return i == rows ? result : result | (scalar_float_le(v + i, rows - i, arg) << i);
+}
+
+TARGET("avx2") static uint64_t avx2_int_gt(const void *values, int rows, const KernelArg *arg) {
+    const int *v = values;
+    __m256i threshold = _mm256_set1_epi32(arg->i);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        __m256i greater = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(v + i)), threshold);
+        result |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(greater)) << i;
+    }
+    return i == rows ? result : result | (scalar_int_gt(v + i, rows - i, arg) << i);
+}
+
+TARGET("avx2") static uint64_t avx2_int_le(const void *values, int rows, const KernelArg *arg) {
+    const int *v = values;
+    __m256i threshold = _mm256_set1_epi32(arg->i);
+    uint64_t result = 0;
+    int i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        __m256i greater = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(v + i)), threshold);
+        result |= (uint64_t)(~_mm256_movemask_ps(_mm256_castsi256_ps(greater)) & 0xff) << i;
+    }
+    return i == rows ? result : result | (scalar_int_le(v + i, rows - i, arg) << i);
+}
+
+TARGET("avx2") static int64_t avx2_sum_int(const int *values, uint64_t mask, int rows) {
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        int bits = (int)((mask >> i) & 0xf);
+        if (bits == 0) continue;
+        __m256i v = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(values + i)));
+        sum = _mm256_add_epi64(sum, _mm256_and_si256(v, _mm256_loadu_si256((const __m256i *)lane_masks4[bits])));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_sum_int(values, mask & ~rows_mask(i), rows);
+}
+
+TARGET("avx2") static double avx2_sum_sub_population(const float *percentages, const int *population, uint64_t mask, int rows) {
+    const __m256d hundred = _mm256_set1_pd(100.0);
+    __m256d sum = _mm256_setzero_pd();  // Accumulators 0 to 3
+    int i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        int bits = (int)((mask >> i) & 0xf);
+        if (bits == 0) continue;
+        __m256d pct = _mm256_cvtps_pd(_mm_loadu_ps(percentages + i));
+        __m256d pop = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(population + i)));
+        __m256d sub = _mm256_mul_pd(_mm256_div_pd(pct, hundred), pop);
+        sub = _mm256_and_pd(sub, _mm256_cmp_pd(sub, sub, _CMP_ORD_Q));  // NaNs add nothing
+        sum = _mm256_add_pd(sum, _mm256_and_pd(sub, _mm256_loadu_pd((const double *)lane_masks4[bits])));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    scalar_sub_population_lanes(percentages, population, mask, i, lanes);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+#endif
+
+static const Kernels scalar_kernels = {
+    "scalar", scalar_float_ge, scalar_float_le, scalar_int_gt, scalar_int_le,
+    scalar_sum_int, scalar_sum_sub_population
+};
+
+#ifdef HAVE_X86_KERNELS
+static const Kernels sse2_kernels = {
+    "sse2", sse2_float_ge, sse2_float_le, sse2_int_gt, sse2_int_le,
+    sse2_sum_int, sse2_sum_sub_population
+};
+
+static const Kernels avx2_kernels = {
+    "avx2", avx2_float_ge, avx2_float_le, avx2_int_gt, avx2_int_le,
+    avx2_sum_int, avx2_sum_sub_population
+};
+#endif
+
+static const Kernels *selected_kernels = &scalar_kernels;
+
+// Function to pick the widest kernels the CPU supports, capped by PROCESS_SIMD
+void kernels_init(void) {
+    const char *limit = getenv("PROCESS_SIMD");
+    selected_kernels = &scalar_kernels;
+
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (limit != NULL && strcmp(limit, "scalar") == 0) {
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        selected_kernels = &sse2_kernels;
+    }
+    if (limit != NULL && strcmp(limit, "sse2") == 0) {
+        return;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        selected_kernels = &avx2_kernels;
+    }
+#else
+    (void)limit;
+#endif
+}
+
+const Kernels *kernels(void) {
+    return selected_kernels;
+}
+
+// Function to turn a comparison against a double into a kernel on the column
+// type. The threshold is converted so that comparing the raw column values
+// gives exactly the same answer as comparing them as doubles.
+MaskKernel find_mask_kernel(FieldType type, const char *comparison, double number, KernelArg *arg) {
+    int greater = strcmp(comparison, "ge") == 0 || strcmp(comparison, "gt") == 0;
+    int strict = strcmp(comparison, "gt") == 0 || strcmp(comparison, "lt") == 0;
+    if ((!greater && strcmp(comparison, "le") != 0 && strcmp(comparison, "lt") != 0) || isnan(number)) {
+        return match_none;
+    }
+
+    if (type == FIELD_FLOAT) {
+        // Nearest float, then step to the closest float on the matching side.
+        // A strict comparison is the same test against the next float over.
+        if (strict && (greater ? number >= INFINITY : number <= -INFINITY)) {
+            return match_none;
+        }
+        float threshold = number > FLT_MAX ? INFINITY : number < -FLT_MAX ? -INFINITY : (float)number;
+        if (greater && (strict ? threshold <= number : threshold < number)) threshold = nextafterf(threshold, INFINITY);
+        if (!greater && (strict ? threshold >= number : threshold > number)) threshold = nextafterf(threshold, -INFINITY);
+        arg->f = threshold;
+        return greater ? kernels()->float_ge : kernels()->float_le;
+    }
+
+    if (type == FIELD_INT) {
+        if (greater) {
+            // value >= number  <=>  value > ceil(number) - 1
+            // value > number   <=>  value > floor(number)
+            double bound = strict ? floor(number) : ceil(number) - 1;
+            if (bound >= INT_MAX) return match_none;
+            if (bound < INT_MIN) return match_all;
+            arg->i = (int)bound;
+            return kernels()->int_gt;
+        }
+        // value <= number  <=>  value <= floor(number)
+        // value < number   <=>  value <= ceil(number) - 1
+        double bound = strict ? ceil(number) - 1 : floor(number);
+        if (bound >= INT_MAX) return match_all;
+        if (bound < INT_MIN) return match_none;
+        arg->i = (int)bound;
+        return kernels()->int_le;
+    }
+
+    return match_none;
+}
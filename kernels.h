@@ -0,0 +1,75 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+#include <math.h>
+
+#include "table.h"
+
+// Threshold a comparison kernel tests against, converted once to the column's type
+typedef struct {
+    float f;
+    int i;
+} KernelArg;
+
+// Compare rows (at most 64) consecutive values against a threshold, one result bit per row
+typedef uint64_t (*MaskKernel)(const void *values, int rows, const KernelArg *arg);
+
+// The kernels for the best instruction set the CPU supports. All variants of
+// a kernel produce bit-identical results.
+typedef struct {
+    const char *name;
+    MaskKernel float_ge;  // value >= f
+    MaskKernel float_le;  // value <= f
+    MaskKernel int_gt;    // value > i
+    MaskKernel int_le;    // value <= i
+
+    // Sum of the values of the rows whose bit is set in mask
+    int64_t (*sum_int)(const int *values, uint64_t mask, int rows);
+
+    // Sum of percentages[row] / 100 * population[row] for the rows whose bit is
+    // set, skipping the rows where that is NaN. Row j is added to accumulator
+    // j % 4, and the accumulators are combined as (a0 + a1) + (a2 + a3),
+    // whatever the vector width.
+    double (*sum_sub_population)(const float *percentages, const int *population, uint64_t mask, int rows);
+} Kernels;
+
+// A sum of doubles that keeps the rounding error of every addition
+// (Neumaier's variant of Kahan summation), so that adding many partial sums
+// loses almost nothing
+typedef struct {
+    double sum;
+    double error;
+} CompensatedSum;
+
+static inline void compensated_add(CompensatedSum *total, double value) {
+    double sum = total->sum + value;
+    if (fabs(total->sum) >= fabs(value)) {
+        total->error += (total->sum - sum) + value;
+    } else {
+        total->error += (value - sum) + total->sum;
+    }
+    total->sum = sum;
+}
+
+static inline double compensated_value(const CompensatedSum *total) {
+    return total->sum + total->error;
+}
+
+// Pick the kernels for this CPU. The PROCESS_SIMD environment variable
+// ("scalar", "sse2" or "avx2") can force a lower level.
+void kernels_init(void);
+const Kernels *kernels(void);
+
+// Pick the kernel for a "ge", "le", "gt" or "lt" comparison against number
+// on a column of the given type, filling in the threshold it needs. Strict
+// comparisons use the same kernels with the threshold moved to the next
+// value of the column's type.
+MaskKernel find_mask_kernel(FieldType type, const char *comparison, double number, KernelArg *arg);
+
+// Bits set for the first rows rows of a word
+static inline uint64_t rows_mask(int rows) {
+    return rows >= 64 ? ~UINT64_C(0) : (UINT64_C(1) << rows) - 1;
+}
+
+#endif
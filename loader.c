@@ -0,0 +1,695 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "csv.h"
+#include "loader.h"
+
+#define MAX_TOKENS 100
+#define MIN_CHUNK_BYTES (64 * 1024)  // Smallest byte range worth handing to a worker thread
+#define LOAD_BLOCK_ROWS 16384        // Rows staged per block while a range is parsed
+
+// A block of parsed rows, one 4-byte value per column per row
+typedef struct RowBlock {
+    struct RowBlock *next;
+    int row_count;
+    uint32_t *values[];  // values[column][row]
+} RowBlock;
+
+// What the loader does with one field of every record. Built once from the
+// header, so that records are handled column by column without looking up
+// field names.
+typedef struct {
+    int field;     // Index of the field in the config
+    int column;    // Column of the field in the file
+    int required;  // A record without a valid value here is malformed
+    int store;     // Parse and store the value; otherwise it is only checked
+} FieldSlot;
+
+// A byte range of the input parsed by one worker, with its own output buffers
+typedef struct {
+    const MappedFile *file;
+    const FieldSlot *slots;
+    int slot_count;
+    int field_limit;        // Fields of each record that are split out, enough for every slot
+    const Config *config;
+    size_t start;
+    size_t end;
+
+    Arena arena;            // Row blocks and interned strings of this range
+    StringPool strings;
+    char *unescaped;        // Arena space escaped strings are unescaped into before they are interned
+    size_t unescaped_size;
+    RowBlock *first_block;  // Rows parsed from this range, in file order
+    RowBlock *last_block;
+    int row_count;
+    int lines;              // Data lines in this range
+    int *malformed_lines;   // Malformed entries, as line numbers relative to the range
+    int malformed_count;
+    int malformed_capacity;
+    size_t quotes;          // Quote characters in [start, end), used to align ranges
+    size_t stop;            // Where the last record begun in the range ends, which is past end if it runs over
+    int ok;
+} ParseChunk;
+
+// Function to read the header line, adding the columns the config does not
+// know yet and recording the column of every field
+static int read_header(DemographicsFile *input, Config *config) {
+    const MappedFile *file = &input->file;
+    CsvField fields[MAX_TOKENS];
+    int column_fields[MAX_TOKENS];
+
+    // Read the header line
+    int column_count = csv_next_record(file->data, file->size, &input->data_start, fields, MAX_TOKENS, &input->header_lines);
+    if (column_count <= 0) {
+        return 0;
+    }
+    if (column_count > MAX_TOKENS) {
+        column_count = MAX_TOKENS;
+    }
+
+    // Match each header token to a field, adding the ones that are new
+    for (int column = 0; column < column_count; column++) {
+        char name[256];
+        csv_field_copy(file->data, &fields[column], name, sizeof(name));
+        column_fields[column] = name[0] == '\0' ? -1 : find_field(config, name);
+        if (name[0] != '\0' && column_fields[column] == -1) {
+            if (!config_add_field(config, name, FIELD_FLOAT)) {
+                return 0;
+            }
+            column_fields[column] = config->valid_fields_count - 1;
+        }
+    }
+
+    input->field_indices = malloc(config->valid_fields_count * sizeof(int));
+    if (input->field_indices == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    for (int i = 0; i < config->valid_fields_count; i++) {
+        input->field_indices[i] = -1;
+    }
+    for (int column = column_count - 1; column >= 0; column--) {
+        if (column_fields[column] >= 0) {
+            input->field_indices[column_fields[column]] = column;  // The first column with a name wins
+        }
+    }
+    return 1;
+}
+
+// Function to store the fields of one record in the given row of a block.
+// Returns 0 if the record is malformed, -1 if memory ran out.
+static int parse_record(const char *buf, const CsvField *fields, int field_count, ParseChunk *chunk, RowBlock *block, int row) {
+    const Config *config = chunk->config;
+
+    for (int s = 0; s < chunk->slot_count; s++) {
+        const FieldSlot *slot = &chunk->slots[s];
+        FieldType type = config->field_types[slot->field];
+        uint32_t *value = slot->store ? &block->values[slot->field][row] : NULL;
+        int ok = 1;
+
+        if (slot->column >= field_count) {
+            if (slot->required) {
+                return 0;  // Record is missing a required column
+            }
+            *(float *)value = NAN;
+            continue;
+        }
+        const CsvField *field = &fields[slot->column];
+
+        if (!slot->store) {
+            // Not needed, but a bad value still makes the record malformed
+            if ((type == FIELD_FLOAT && !csv_is_float(buf + field->offset, field->length))
+                || (type == FIELD_INT && !csv_is_int(buf + field->offset, field->length))) {
+                return 0;
+            }
+            continue;
+        }
+
+        switch (type) {
+            case FIELD_STRING:
+                if (field->flags & CSV_FIELD_ESCAPED) {
+                    // Unescaping only shortens the field, so field->length bytes always hold it
+                    if (field->length + 1 > chunk->unescaped_size) {
+                        size_t size = chunk->unescaped_size * 2 > field->length + 1 ? chunk->unescaped_size * 2 : field->length + 1;
+                        chunk->unescaped = arena_alloc(&chunk->arena, size, 1);
+                        if (chunk->unescaped == NULL) {
+                            chunk->unescaped_size = 0;
+                            return -1;
+                        }
+                        chunk->unescaped_size = size;
+                    }
+                    size_t length = csv_field_copy(buf, field, chunk->unescaped, chunk->unescaped_size);
+                    *value = string_pool_intern(&chunk->strings, &chunk->arena, chunk->unescaped, length);
+                } else {
+                    *value = string_pool_intern(&chunk->strings, &chunk->arena, buf + field->offset, field->length);
+                }
+                if (*value == STRING_POOL_NONE) {
+                    return -1;
+                }
+                break;
+            case FIELD_FLOAT:
+                ok = csv_parse_float(buf + field->offset, field->length, (float *)value);
+                break;
+            case FIELD_INT:
+                ok = csv_parse_int(buf + field->offset, field->length, (int *)value);
+                break;
+        }
+        if (!ok) {
+            if (slot->required) {
+                return 0;
+            }
+            *(float *)value = NAN;  // Extra columns keep unreadable values as NaN
+        }
+    }
+    return 1;
+}
+
+// Function to start a new block of rows at the end of the chunk
+static RowBlock *add_block(ParseChunk *chunk) {
+    int column_count = chunk->config->valid_fields_count;
+    RowBlock *block = arena_alloc(&chunk->arena, sizeof(RowBlock) + column_count * sizeof(uint32_t *), sizeof(void *));
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->row_count = 0;
+    for (int i = 0; i < column_count; i++) {
+        block->values[i] = NULL;
+    }
+    for (int s = 0; s < chunk->slot_count; s++) {
+        if (chunk->slots[s].store) {
+            int i = chunk->slots[s].field;
+            block->values[i] = arena_alloc(&chunk->arena, LOAD_BLOCK_ROWS * sizeof(uint32_t), 64);
+            if (block->values[i] == NULL) {
+                return NULL;
+            }
+        }
+    }
+
+    if (chunk->last_block != NULL) {
+        chunk->last_block->next = block;
+    } else {
+        chunk->first_block = block;
+    }
+    chunk->last_block = block;
+    return block;
+}
+
+static int add_malformed_line(ParseChunk *chunk, int line_number) {
+    if (chunk->malformed_count == chunk->malformed_capacity) {
+        int capacity = chunk->malformed_capacity ? chunk->malformed_capacity * 2 : 16;
+        int *grown = realloc(chunk->malformed_lines, capacity * sizeof(int));
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 0;
+        }
+        chunk->malformed_lines = grown;
+        chunk->malformed_capacity = capacity;
+    }
+    chunk->malformed_lines[chunk->malformed_count++] = line_number;
+    return 1;
+}
+
+// Function to parse records from *pos into block until it is full or the
+// range ends. Records are scanned in place; the fields are never copied out
+// of the mapping. A record that begins in the range is read to its end, even
+// past the end of the range. Returns 0 if memory ran out.
+static int fill_block(ParseChunk *chunk, size_t *pos, RowBlock *block) {
+    const MappedFile *file = chunk->file;
+    CsvField fields[MAX_TOKENS];
+
+    while (*pos < chunk->end && block->row_count < LOAD_BLOCK_ROWS) {
+        int line_number = chunk->lines + 1;  // Line the record starts on, relative to the range
+        int field_count = csv_next_record_prefix(file->data, file->size, pos, fields, chunk->field_limit, &chunk->lines);
+        if (field_count < 0) {
+            break;
+        }
+
+        // Skip blank lines
+        if (field_count == 1 && fields[0].length == 0 && !(fields[0].flags & CSV_FIELD_QUOTED)) {
+            continue;
+        }
+
+        int parsed = parse_record(file->data, fields, field_count, chunk, block, block->row_count);
+        if (parsed < 0 || (parsed == 0 && !add_malformed_line(chunk, line_number))) {
+            return 0;
+        }
+        if (parsed == 0) {
+            continue;  // Skip the current record and move to the next line
+        }
+
+        block->row_count++;
+        chunk->row_count++;
+    }
+    return 1;
+}
+
+// Function to parse every record in a byte range into the chunk's blocks
+static void parse_chunk(ParseChunk *chunk) {
+    RowBlock *block = chunk->last_block;
+    size_t pos = chunk->start;
+
+    chunk->ok = 1;
+    while (pos < chunk->end) {
+        if (block == NULL || block->row_count == LOAD_BLOCK_ROWS) {
+            block = add_block(chunk);
+            if (block == NULL) {
+                chunk->ok = 0;
+                return;
+            }
+        }
+        if (!fill_block(chunk, &pos, block)) {
+            chunk->ok = 0;
+            return;
+        }
+    }
+    chunk->stop = pos;
+}
+
+// Function to parse a range again from start, dropping what was parsed
+// from it before
+static void reparse_chunk(ParseChunk *chunk, size_t start) {
+    string_pool_free(&chunk->strings);
+    arena_free(&chunk->arena);
+    arena_init(&chunk->arena, ARENA_SLAB_SIZE);
+    string_pool_init(&chunk->strings);
+    chunk->unescaped = NULL;
+    chunk->unescaped_size = 0;
+    chunk->first_block = NULL;
+    chunk->last_block = NULL;
+    chunk->row_count = 0;
+    chunk->lines = 0;
+    chunk->malformed_count = 0;
+    chunk->start = start;
+    parse_chunk(chunk);
+}
+
+// Function to append the rows of a parsed range to the table, re-interning
+// its strings into the table's string pool
+static int merge_chunk(Table *table, ParseChunk *chunk, const int *field_indices) {
+    uint32_t *remap = malloc((chunk->strings.count > 0 ? chunk->strings.count : 1) * sizeof(uint32_t));
+    if (remap == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    for (uint32_t id = 0; id < chunk->strings.count; id++) {
+        remap[id] = string_pool_intern(&table->strings, &table->arena, chunk->strings.strings[id], chunk->strings.lengths[id]);
+        if (remap[id] == STRING_POOL_NONE) {
+            free(remap);
+            return 0;
+        }
+    }
+
+    for (RowBlock *block = chunk->first_block; block != NULL; block = block->next) {
+        int row = table->row_count;
+        for (int i = 0; i < table->column_count; i++) {
+            const uint32_t *values = block->values[i];
+            Column *column = &table->columns[i];
+            if (column_data(column) == NULL) {
+                continue;  // Column not loaded
+            }
+            if (field_indices[i] < 0) {
+                // Field not present in the header: zero, or the empty string
+                memset((uint32_t *)column_data(column) + row, 0, block->row_count * sizeof(uint32_t));
+                continue;
+            }
+            switch (column->type) {
+                case FIELD_STRING:
+                    for (int j = 0; j < block->row_count; j++) {
+                        column->strings[row + j] = remap[values[j]];
+                    }
+                    break;
+                case FIELD_FLOAT: memcpy(column->floats + row, values, block->row_count * sizeof(float)); break;
+                case FIELD_INT: memcpy(column->ints + row, values, block->row_count * sizeof(int)); break;
+            }
+        }
+        table->row_count += block->row_count;
+    }
+
+    free(remap);
+    return 1;
+}
+
+static void *parse_chunk_thread(void *arg) {
+    parse_chunk(arg);
+    return NULL;
+}
+
+static void *count_quotes_thread(void *arg) {
+    ParseChunk *chunk = arg;
+    const char *p = chunk->file->data + chunk->start;
+    const char *end = chunk->file->data + chunk->end;
+    size_t quotes = 0;
+    while (p < end && (p = memchr(p, '"', (size_t)(end - p))) != NULL) {
+        quotes++;
+        p++;
+    }
+    chunk->quotes = quotes;
+    return NULL;
+}
+
+// Run fn on every chunk, one thread per chunk
+static int run_chunks(ParseChunk *chunks, int chunk_count, void *(*fn)(void *)) {
+    pthread_t *workers = malloc(chunk_count * sizeof(pthread_t));
+    int *started = calloc(chunk_count, sizeof(int));
+    if (workers == NULL || started == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(workers);
+        free(started);
+        return 0;
+    }
+
+    for (int i = 1; i < chunk_count; i++) {
+        started[i] = pthread_create(&workers[i], NULL, fn, &chunks[i]) == 0;
+    }
+    fn(&chunks[0]);
+
+    for (int i = 1; i < chunk_count; i++) {
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+        } else {
+            fn(&chunks[i]);  // Could not start a thread, do its work here instead
+        }
+    }
+    free(workers);
+    free(started);
+    return 1;
+}
+
+// Function to split [start, size) into byte ranges that should begin on
+// record boundaries. A newline only ends a record when it is outside quotes,
+// so the quotes in each evenly sized range are counted first (in parallel);
+// the parity of the quotes before a split point then tells whether it is
+// inside a quoted field, and the split point is moved forward past the next
+// newline that is outside quotes. The parity is only a guess: a quote inside
+// an unquoted value or after a closing quote opens nothing for the scanner.
+// Ranges that do not start where the records before them stop are parsed
+// again once the records before them are known (see process_demographics_file).
+static int split_chunks(const MappedFile *file, size_t start, ParseChunk *chunks, int chunk_count) {
+    size_t length = file->size - start;
+    for (int i = 0; i < chunk_count; i++) {
+        chunks[i].start = start + length * i / chunk_count;
+        chunks[i].end = start + length * (i + 1) / chunk_count;
+    }
+    if (!run_chunks(chunks, chunk_count, count_quotes_thread)) {
+        return 0;
+    }
+
+    size_t quotes_before = chunks[0].quotes;
+    for (int i = 1; i < chunk_count; i++) {
+        int in_quotes = quotes_before % 2;
+        size_t pos = chunks[i].start;
+
+        quotes_before += chunks[i].quotes;
+        while (pos < file->size) {
+            char c = file->data[pos++];
+            if (c == '"') {
+                in_quotes = !in_quotes;
+            } else if (c == '\n' && !in_quotes) {
+                break;
+            }
+        }
+        chunks[i].start = pos;
+        chunks[i - 1].end = pos;
+    }
+    chunks[chunk_count - 1].end = file->size;
+    return 1;
+}
+
+int open_demographics_file(const char *demographics_file, DemographicsFile *input, Config *config, const char **error) {
+    memset(input, 0, sizeof(*input));
+    if (!map_file(demographics_file, &input->file)) {
+        if (error != NULL) {
+            *error = "Could not open file";
+        } else {
+            fprintf(stderr, "Could not open file: %s\n", demographics_file);
+        }
+        return 0;
+    }
+
+    // Read the header line and find the columns of the fields
+    if (!read_header(input, config)) {
+        if (error != NULL) {
+            *error = "Failed to read header or invalid format";
+        } else {
+            fprintf(stderr, "Failed to read header or invalid format\n");
+        }
+        close_demographics_file(input);
+        return 0;
+    }
+    return 1;
+}
+
+void close_demographics_file(DemographicsFile *input) {
+    free(input->field_indices);
+    input->field_indices = NULL;
+    if (input->file.data != NULL) {
+        unmap_file(&input->file);
+    }
+}
+
+// Function to build the slot list: the fields to store, and the required
+// fields that are only checked
+static FieldSlot *build_slots(const DemographicsFile *input, const Config *config, const unsigned char *load, int *slot_count) {
+    FieldSlot *slots = malloc((config->valid_fields_count > 0 ? config->valid_fields_count : 1) * sizeof(FieldSlot));
+    if (slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+
+    *slot_count = 0;
+    for (int i = 0; i < config->valid_fields_count; i++) {
+        FieldSlot slot;
+        slot.field = i;
+        slot.column = input->field_indices[i];
+        slot.required = i < config->required_count;
+        slot.store = load == NULL || load[i];
+        if (slot.column < 0 || (!slot.required && !slot.store)) {
+            continue;  // Not in the file, or nothing to do
+        }
+        slots[(*slot_count)++] = slot;
+    }
+    return slots;
+}
+
+// Function to find how many fields of each record to split out. Records are
+// only split up to the last column a slot reads. At least two fields are kept
+// so that a blank line still stands out.
+static int slot_field_limit(const FieldSlot *slots, int slot_count) {
+    int field_limit = 2;
+    for (int s = 0; s < slot_count; s++) {
+        if (slots[s].column + 1 > field_limit) {
+            field_limit = slots[s].column + 1;
+        }
+    }
+    return field_limit;
+}
+
+// Function to report the malformed entries of a chunk, numbering the lines
+// from the first data line given the lines before the chunk
+static void report_malformed(const ParseChunk *chunk, int line_offset) {
+    for (int j = 0; j < chunk->malformed_count; j++) {
+        fprintf(stderr, "Malformed entry at line %d. Skipping entry.\n", line_offset + chunk->malformed_lines[j]);
+    }
+}
+
+int process_demographics_file(DemographicsFile *input, Table *table, const Config *config, const unsigned char *load, int threads) {
+    const MappedFile *file = &input->file;
+    size_t pos = input->data_start;
+    memset(table, 0, sizeof(*table));
+
+    int slot_count;
+    FieldSlot *slots = build_slots(input, config, load, &slot_count);
+    if (slots == NULL) {
+        return -1;
+    }
+
+    int field_limit = slot_field_limit(slots, slot_count);
+
+    // Use one range per thread, but never ranges too small to be worth a thread
+    int chunk_count = threads > 1 ? threads : 1;
+    size_t data_size = file->size - pos;
+    if ((size_t)chunk_count > data_size / MIN_CHUNK_BYTES) {
+        chunk_count = data_size / MIN_CHUNK_BYTES > 1 ? (int)(data_size / MIN_CHUNK_BYTES) : 1;
+    }
+
+    ParseChunk *chunks = calloc(chunk_count, sizeof(ParseChunk));
+    if (chunks == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(slots);
+        return -1;
+    }
+    for (int i = 0; i < chunk_count; i++) {
+        chunks[i].file = file;
+        chunks[i].slots = slots;
+        chunks[i].slot_count = slot_count;
+        chunks[i].field_limit = field_limit;
+        chunks[i].config = config;
+        arena_init(&chunks[i].arena, ARENA_SLAB_SIZE);
+        string_pool_init(&chunks[i].strings);
+    }
+
+    int ok = 1;
+    if (chunk_count == 1) {
+        chunks[0].start = pos;
+        chunks[0].end = file->size;
+        parse_chunk(&chunks[0]);
+    } else {
+        ok = split_chunks(file, pos, chunks, chunk_count) && run_chunks(chunks, chunk_count, parse_chunk_thread);
+
+        // A range whose split point the quotes misled starts inside a record,
+        // or after one the range before it runs over. Parse it again from
+        // where the records before it stop, so that the ranges hold exactly
+        // the records a single pass over the file finds.
+        for (int i = 1; i < chunk_count && ok && chunks[i - 1].ok; i++) {
+            if (chunks[i].start != chunks[i - 1].stop) {
+                reparse_chunk(&chunks[i], chunks[i - 1].stop);
+            }
+        }
+    }
+
+    // Size the table exactly now that the number of rows is known
+    int row_count = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        ok = ok && chunks[i].ok;
+        row_count += chunks[i].row_count;
+    }
+    ok = ok && table_init(table, config, row_count, load);
+
+    // Merge the ranges in file order, reporting malformed entries with their
+    // line numbers relative to the first data line
+    int line_offset = 0;
+    input->malformed_count = 0;
+    for (int i = 0; i < chunk_count && ok; i++) {
+        ParseChunk *chunk = &chunks[i];
+        ok = merge_chunk(table, chunk, input->field_indices);
+        input->malformed_count += chunk->malformed_count;
+        report_malformed(chunk, line_offset);
+        line_offset += chunk->lines;
+    }
+
+    for (int i = 0; i < chunk_count; i++) {
+        string_pool_free(&chunks[i].strings);
+        arena_free(&chunks[i].arena);
+        free(chunks[i].malformed_lines);
+    }
+    free(chunks);
+    free(slots);
+
+    if (!ok) {
+        table_free(table);
+        return -1;
+    }
+    return table->row_count;
+}
+
+// A demographics file read one block at a time. A single chunk covers all
+// the records; its one block is refilled for every call, and its string pool
+// keeps growing so that string ids stay the same from block to block.
+struct DemographicsStream {
+    DemographicsFile *input;
+    FieldSlot *slots;
+    ParseChunk chunk;
+    RowBlock *block;
+    size_t pos;
+    size_t released;  // The mapped file is dropped from memory up to here
+    uint32_t *zeros;  // Values of loaded fields the header does not have
+    Table table;      // The rows of the current block
+};
+
+DemographicsStream *open_demographics_stream(DemographicsFile *input, const Config *config, const unsigned char *load, const Table **table) {
+    DemographicsStream *stream = calloc(1, sizeof(DemographicsStream));
+    if (stream == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    ParseChunk *chunk = &stream->chunk;
+    arena_init(&chunk->arena, ARENA_SLAB_SIZE);
+    string_pool_init(&chunk->strings);
+    stream->input = input;
+    stream->pos = input->data_start;
+    stream->released = 0;
+    input->malformed_count = 0;
+
+    int slot_count = 0;
+    stream->slots = build_slots(input, config, load, &slot_count);
+    chunk->file = &input->file;
+    chunk->slots = stream->slots;
+    chunk->slot_count = slot_count;
+    chunk->field_limit = slot_field_limit(stream->slots, slot_count);
+    chunk->config = config;
+    chunk->start = input->data_start;
+    chunk->end = input->file.size;
+    chunk->ok = 1;
+
+    // String id 0 is the empty string, as in a loaded table
+    Table *view = &stream->table;
+    view->column_count = config->valid_fields_count;
+    view->capacity = LOAD_BLOCK_ROWS;
+    view->columns = calloc(view->column_count > 0 ? view->column_count : 1, sizeof(Column));
+    stream->zeros = calloc(LOAD_BLOCK_ROWS, sizeof(uint32_t));
+    if (stream->slots == NULL || view->columns == NULL || stream->zeros == NULL
+        || string_pool_intern(&chunk->strings, &chunk->arena, "", 0) != 0
+        || (stream->block = add_block(chunk)) == NULL) {
+        if (stream->slots != NULL) fprintf(stderr, "Memory allocation failed\n");
+        close_demographics_stream(stream);
+        return NULL;
+    }
+
+    for (int i = 0; i < view->column_count; i++) {
+        Column *column = &view->columns[i];
+        column->type = config->field_types[i];
+        if (load != NULL && !load[i]) {
+            continue;
+        }
+        uint32_t *values = input->field_indices[i] >= 0 ? stream->block->values[i] : stream->zeros;
+        switch (column->type) {
+            case FIELD_STRING: column->strings = values; break;
+            case FIELD_FLOAT: column->floats = (float *)values; break;
+            case FIELD_INT: column->ints = (int *)values; break;
+        }
+    }
+    view->strings = chunk->strings;
+    *table = view;
+    return stream;
+}
+
+int next_demographics_block(DemographicsStream *stream) {
+    ParseChunk *chunk = &stream->chunk;
+    RowBlock *block = stream->block;
+    block->row_count = 0;
+    int ok = fill_block(chunk, &stream->pos, block);
+
+    // The records read so far are never looked at again
+    stream->released = release_file_pages(&stream->input->file, stream->released, stream->pos);
+
+    // Malformed entries are reported as they are found, numbered from the
+    // first data line as a load would number them
+    report_malformed(chunk, 0);
+    stream->input->malformed_count += chunk->malformed_count;
+    chunk->malformed_count = 0;
+
+    // The pool's arrays move as it grows
+    stream->table.strings = chunk->strings;
+    stream->table.row_count = block->row_count;
+    if (!ok) {
+        return -1;
+    }
+    return block->row_count > 0;
+}
+
+void close_demographics_stream(DemographicsStream *stream) {
+    if (stream == NULL) return;
+    string_pool_free(&stream->chunk.strings);
+    arena_free(&stream->chunk.arena);
+    free(stream->chunk.malformed_lines);
+    free(stream->table.columns);
+    free(stream->zeros);
+    free(stream->slots);
+    free(stream);
+}
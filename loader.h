@@ -0,0 +1,50 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "table.h"
+#include "csv.h"
+
+// A demographics file opened for loading: mapped, with its header read
+typedef struct {
+    MappedFile file;
+    size_t data_start;   // Offset of the first record after the header
+    int header_lines;
+    int *field_indices;  // Column of each config field in the file, or -1
+    int malformed_count; // Records process_demographics_file skipped as malformed
+} DemographicsFile;
+
+// Map the demographics file and read its header. Header columns the config
+// does not list yet are added to it as float fields. Returns 0 on error,
+// after printing what went wrong to stderr or, if error is not NULL,
+// pointing *error at it instead.
+int open_demographics_file(const char *demographics_file, DemographicsFile *input, Config *config, const char **error);
+
+// Load the records into table, using up to threads worker threads. Only the
+// fields whose entry in load is set are stored (all of them if load is
+// NULL), but every record is still checked against all required fields.
+// Returns the number of records loaded or -1 on error.
+int process_demographics_file(DemographicsFile *input, Table *table, const Config *config, const unsigned char *load, int threads);
+
+void close_demographics_file(DemographicsFile *input);
+
+// The records of a demographics file read a block at a time, so that memory
+// use does not grow with the size of the file
+typedef struct DemographicsStream DemographicsStream;
+
+// Start reading the records of input, with the same fields stored and the
+// same checks as process_demographics_file. *table is pointed at a table
+// that holds the rows of the current block; it has no rows until the first
+// block is read, and stays valid until the stream is closed. Returns NULL on
+// error.
+DemographicsStream *open_demographics_stream(DemographicsFile *input, const Config *config, const unsigned char *load, const Table **table);
+
+// Read the next block of records into the stream's table, replacing the
+// rows of the last one. String ids keep their meaning from block to block.
+// Malformed records are reported as they are skipped and counted in the
+// file's malformed_count. Returns 1 for a block, 0 at the end of the file
+// and -1 on error.
+int next_demographics_block(DemographicsStream *stream);
+
+void close_demographics_stream(DemographicsStream *stream);
+
+#endif
@@ -0,0 +1,701 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "output.h"
+
+// Header of the CSV results table; every result is one row of it
+#define CSV_RESULTS_HEADER "operation,field,comparison,operand,group_by,group,value,message\n"
+
+int output_format(const char *name, OutputFormat *format) {
+    static const char *names[] = { "human", "csv", "jsonl", "binary" };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *format = (OutputFormat)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int output_init(Output *output, FILE *out, FILE *err, OutputFormat format) {
+    output->err = err;
+    output->format = format;
+    output->results_header = 0;
+    if (!writer_init(&output->writer, out)) {
+        return 0;
+    }
+    if (format == OUTPUT_BINARY) {
+        writer_string(&output->writer, OUTPUT_BINARY_MAGIC);
+    }
+    return 1;
+}
+
+void output_free(Output *output) {
+    writer_free(&output->writer);
+}
+
+// Function to write a CSV field, quoted if it holds a comma, a quote or a line break
+static void csv_text(Writer *w, const char *text) {
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        writer_string(w, text);
+        return;
+    }
+    writer_char(w, '"');
+    for (const char *c = text; *c; c++) {
+        if (*c == '"') writer_char(w, '"');
+        writer_char(w, *c);
+    }
+    writer_char(w, '"');
+}
+
+// Length of the UTF-8 sequence starting at c, or 0 if it is not valid UTF-8
+static int utf8_length(const unsigned char *c) {
+    int length = c[0] >= 0xf0 && c[0] <= 0xf4 ? 4 : c[0] >= 0xe0 ? 3 : c[0] >= 0xc2 && c[0] <= 0xdf ? 2 : 0;
+    if (c[0] > 0xf4) {
+        return 0;
+    }
+    for (int i = 1; i < length; i++) {
+        if ((c[i] & 0xc0) != 0x80) return 0;
+    }
+    return length;
+}
+
+// Function to write a JSON string, escaping quotes, backslashes and control
+// characters. The data is not all UTF-8; a byte that does not start a valid
+// UTF-8 sequence is written as the Latin-1 character with its value.
+static void json_text(Writer *w, const char *text) {
+    writer_char(w, '"');
+    const unsigned char *c = (const unsigned char *)text;
+    while (*c) {
+        // Copy the run of characters that need no escaping in one go
+        const unsigned char *run = c;
+        while (*c >= 0x20 && *c < 0x80 && *c != '"' && *c != '\\') c++;
+        writer_bytes(w, run, c - run);
+        if (*c == '\0') {
+            break;
+        }
+        if (*c >= 0x80) {
+            int length = utf8_length(c);
+            if (length == 0) {
+                writer_printf(w, "\\u%04x", *c);
+                length = 1;
+            } else {
+                writer_bytes(w, c, length);
+            }
+            c += length;
+            continue;
+        }
+        if (*c == '"' || *c == '\\') {
+            writer_char(w, '\\');
+            writer_char(w, (char)*c);
+        } else if (*c == '\n') {
+            writer_string(w, "\\n");
+        } else {
+            writer_printf(w, "\\u%04x", *c);
+        }
+        c++;
+    }
+    writer_char(w, '"');
+}
+
+// Binary values, little-endian whatever the host
+static void put_u16(Writer *w, uint32_t value) {
+    unsigned char bytes[2] = { (unsigned char)value, (unsigned char)(value >> 8) };
+    writer_bytes(w, bytes, sizeof(bytes));
+}
+
+static void put_u32(Writer *w, uint32_t value) {
+    unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8),
+                               (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+    writer_bytes(w, bytes, sizeof(bytes));
+}
+
+static void put_f32(Writer *w, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32(w, bits);
+}
+
+static void put_f64(Writer *w, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32(w, (uint32_t)bits);
+    put_u32(w, (uint32_t)(bits >> 32));
+}
+
+// Strings are a 16-bit length and the bytes, cut at 65535 bytes
+static void put_text(Writer *w, const char *text) {
+    if (text == NULL) text = "";
+    size_t length = strlen(text);
+    if (length > 0xffff) length = 0xffff;
+    put_u16(w, (uint32_t)length);
+    writer_bytes(w, text, length);
+}
+
+// One result in a machine-readable format. Absent parts are NULL; a value
+// that could not be computed is NAN.
+typedef struct {
+    const char *operation;
+    const char *field;
+    const char *comparison;
+    const char *operand;
+    const char *group_by;
+    const char *group;
+    double value;
+    int integer;          // The value is a count or a population
+    const char *message;
+} Result;
+
+static void write_result(Output *output, const Result *r) {
+    Writer *w = &output->writer;
+    switch (output->format) {
+        case OUTPUT_CSV: {
+            if (!output->results_header) {
+                writer_string(w, CSV_RESULTS_HEADER);
+                output->results_header = 1;
+            }
+            const char *parts[6] = { r->operation, r->field, r->comparison, r->operand, r->group_by, r->group };
+            for (int i = 0; i < 6; i++) {
+                if (parts[i] != NULL) csv_text(w, parts[i]);
+                writer_char(w, ',');
+            }
+            if (r->integer) {
+                writer_int(w, (long long)r->value);
+            } else if (!isnan(r->value)) {
+                writer_double(w, r->value);
+            }
+            writer_char(w, ',');
+            if (r->message != NULL) csv_text(w, r->message);
+            writer_char(w, '\n');
+            break;
+        }
+        case OUTPUT_JSONL: {
+            const char *keys[7] = { "op", "field", "comparison", "operand", "group_by", "group", "message" };
+            const char *parts[7] = { r->operation, r->field, r->comparison, r->operand, r->group_by, r->group, r->message };
+            writer_char(w, '{');
+            for (int i = 0; i < 7; i++) {
+                if (parts[i] == NULL) continue;
+                if (i > 0) writer_string(w, ", ");
+                json_text(w, keys[i]);
+                writer_string(w, ": ");
+                json_text(w, parts[i]);
+            }
+            if (strcmp(r->operation, "message") != 0) {
+                writer_string(w, ", \"value\": ");
+                if (r->integer) {
+                    writer_int(w, (long long)r->value);
+                } else if (isfinite(r->value)) {
+                    writer_double(w, r->value);
+                } else {
+                    writer_string(w, "null");
+                }
+            }
+            writer_string(w, "}\n");
+            break;
+        }
+        case OUTPUT_BINARY:
+            if (strcmp(r->operation, "message") == 0) {
+                writer_char(w, 'M');
+                put_text(w, r->message);
+                break;
+            }
+            writer_char(w, 'A');
+            put_text(w, r->operation);
+            put_text(w, r->field);
+            put_text(w, r->comparison);
+            put_text(w, r->operand);
+            put_text(w, r->group_by);
+            put_text(w, r->group);
+            put_f64(w, r->value);
+            break;
+        case OUTPUT_HUMAN:
+            break;
+    }
+}
+
+static Result result(const char *operation, const char *field, const char *group_by, const char *group, double value) {
+    Result r = { operation, field, NULL, NULL, group_by, group, value, 0, NULL };
+    return r;
+}
+
+void output_loaded(Output *output, int rows) {
+    if (output->format == OUTPUT_HUMAN) {
+        writer_int(&output->writer, rows);
+        writer_string(&output->writer, " records loaded\n");
+    } else if (output->format == OUTPUT_BINARY) {
+        writer_char(&output->writer, 'L');
+        put_u32(&output->writer, (uint32_t)rows);
+    } else {
+        Result r = result("load", NULL, NULL, NULL, rows);
+        r.integer = 1;
+        write_result(output, &r);
+    }
+}
+
+void output_filter_state(Output *output, const char *states, int rows) {
+    const char *comparison = strchr(states, ',') != NULL ? "in" : "==";
+    if (output->format == OUTPUT_HUMAN) {
+        writer_printf(&output->writer, "Filter: state %s %s (%d entries)\n", comparison, states, rows);
+        return;
+    }
+    Result r = result("filter-state", "State", NULL, NULL, rows);
+    r.comparison = comparison;
+    r.operand = states;
+    r.integer = 1;
+    write_result(output, &r);
+}
+
+void output_filter(Output *output, const char *field, const char *comparison, double operand, int rows) {
+    if (output->format == OUTPUT_HUMAN) {
+        writer_printf(&output->writer, "Filter: %s %s %.2f (%d entries)\n", field, comparison, operand, rows);
+        return;
+    }
+    char number[32];
+    double_text(number, sizeof(number), operand);
+    Result r = result("filter", field, NULL, NULL, rows);
+    r.comparison = comparison;
+    r.operand = number;
+    r.integer = 1;
+    write_result(output, &r);
+}
+
+void output_filter_expression(Output *output, const char *text, const char *exact, int rows) {
+    if (output->format == OUTPUT_HUMAN) {
+        writer_printf(&output->writer, "Filter: %s (%d entries)\n", text, rows);
+        return;
+    }
+    Result r = result("filter", NULL, NULL, NULL, rows);
+    r.comparison = "expression";
+    r.operand = exact;
+    r.integer = 1;
+    write_result(output, &r);
+}
+
+void output_top(Output *output, const char *field, int limit, int descending, int rows) {
+    const char *direction = descending ? "desc" : "asc";
+    if (output->format == OUTPUT_HUMAN) {
+        writer_printf(&output->writer, "Top: %d by %s %s (%d entries)\n", limit, field, direction, rows);
+        return;
+    }
+    char number[16];
+    snprintf(number, sizeof(number), "%d", limit);
+    Result r = result("top", field, NULL, NULL, rows);
+    r.comparison = direction;
+    r.operand = number;
+    r.integer = 1;
+    write_result(output, &r);
+}
+
+void output_sort(Output *output, const char *field, int descending, int rows) {
+    const char *direction = descending ? "desc" : "asc";
+    if (output->format == OUTPUT_HUMAN) {
+        writer_printf(&output->writer, "Sort: by %s %s (%d entries)\n", field, direction, rows);
+        return;
+    }
+    Result r = result("sort", field, NULL, NULL, rows);
+    r.comparison = direction;
+    r.integer = 1;
+    write_result(output, &r);
+}
+
+void output_join(Output *output, const char *file, const char *keys, int rows) {
+    if (output->format == OUTPUT_HUMAN) {
+        writer_printf(&output->writer, "Join: %s on %s (%d entries)\n", file, keys, rows);
+        return;
+    }
+    Result r = result("join", keys, NULL, NULL, rows);
+    r.operand = file;
+    r.integer = 1;
+    write_result(output, &r);
+}
+
+void output_population_total(Output *output, const char *group_by, const char *group, int64_t population) {
+    Writer *w = &output->writer;
+    if (output->format == OUTPUT_HUMAN) {
+        if (group_by != NULL) {
+            writer_string(w, "2014 population (");
+            writer_string(w, group_by);
+            writer_string(w, " == ");
+            writer_string(w, group);
+            writer_string(w, "): ");
+        } else {
+            writer_string(w, "2014 population: ");
+        }
+        writer_int(w, population);
+        writer_char(w, '\n');
+        return;
+    }
+    Result r = result("population-total", NULL, group_by, group, (double)population);
+    r.integer = 1;
+    write_result(output, &r);
+}
+
+void output_population(Output *output, const char *field, const char *group_by, const char *group, double population) {
+    if (output->format == OUTPUT_HUMAN) {
+        if (group_by != NULL) {
+            writer_printf(&output->writer, "2014 %s population (%s == %s): %f\n", field, group_by, group, population);
+        } else {
+            writer_printf(&output->writer, "2014 %s population: %f\n", field, population);
+        }
+        return;
+    }
+    Result r = result("population", field, group_by, group, population);
+    write_result(output, &r);
+}
+
+void output_percent(Output *output, const char *field, const char *group_by, const char *group, int64_t total, double percentage) {
+    if (output->format == OUTPUT_HUMAN) {
+        if (total > 0 && group_by != NULL) {
+            writer_printf(&output->writer, "2014 %s percentage (%s == %s): %f\n", field, group_by, group, percentage);
+        } else if (total > 0) {
+            writer_printf(&output->writer, "2014 %s percentage: %f\n", field, percentage);
+        } else if (group_by != NULL) {
+            writer_printf(&output->writer, "Total population is 0 (%s == %s), cannot compute percentage.\n", group_by, group);
+        } else {
+            writer_string(&output->writer, "Total population is 0, cannot compute percentage.\n");
+        }
+        return;
+    }
+    Result r = result("percent", field, group_by, group, total > 0 ? percentage : NAN);
+    if (total <= 0) {
+        r.message = "Total population is 0, cannot compute percentage.";
+    }
+    write_result(output, &r);
+}
+
+void output_message(Output *output, const char *text, int error) {
+    if (error && output->err != output->writer.file) {
+        // Keep the message in order with the results written before it
+        writer_flush(&output->writer);
+        fputs(text, output->err);
+        return;
+    }
+    if (error || output->format == OUTPUT_HUMAN) {
+        writer_string(&output->writer, text);
+        return;
+    }
+    char message[256];
+    snprintf(message, sizeof(message), "%.*s", (int)strcspn(text, "\n"), text);
+    Result r = result("message", NULL, NULL, NULL, NAN);
+    r.message = message;
+    write_result(output, &r);
+}
+
+// A display format split around its one conversion, for instance
+// "Population 2014: %d\n\n" into "Population 2014: ", 'd' and "\n\n"
+typedef struct {
+    char *prefix;
+    char *suffix;
+    char conversion;  // 0 if the format is not a lone %s, %f or %d; printf then
+} DisplayFormat;
+
+// Function to copy format text up to end, turning "%%" into "%". Returns
+// NULL if memory ran out.
+static char *unescape(const char *start, const char *end) {
+    char *text = malloc(end - start + 1);
+    char *out = text;
+    if (text == NULL) {
+        return NULL;
+    }
+    for (const char *c = start; c < end; c++) {
+        *out++ = *c;
+        if (c[0] == '%' && c + 1 < end && c[1] == '%') c++;
+    }
+    *out = '\0';
+    return text;
+}
+
+// Function to split a display format for the fast path
+static int split_format(const char *format, FieldType type, DisplayFormat *split) {
+    const char *c = format;
+    const char *conversion = NULL;
+    for (; *c; c++) {
+        if (c[0] != '%') continue;
+        if (c[1] == '%') {
+            c++;
+        } else if (conversion == NULL) {
+            conversion = c;
+        } else {
+            conversion = NULL;  // More than one conversion
+            break;
+        }
+    }
+    split->conversion = 0;
+    split->prefix = split->suffix = NULL;
+    if (conversion == NULL || *c != '\0') {
+        return 1;
+    }
+    char expected = type == FIELD_STRING ? 's' : type == FIELD_FLOAT ? 'f' : 'd';
+    if (conversion[1] != expected) {
+        return 1;
+    }
+    split->prefix = unescape(format, conversion);
+    split->suffix = unescape(conversion + 2, c);
+    if (split->prefix == NULL || split->suffix == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    split->conversion = expected;
+    return 1;
+}
+
+// Function to step to the next row to display: the next of rows if there
+// are rows, else the next selected row. Returns -1 after the last one.
+static int next_row(const Selection *selection, const uint32_t *rows, int row_count, int *position) {
+    if (rows != NULL) {
+        return *position < row_count ? (int)rows[(*position)++] : -1;
+    }
+    int row = selection_next(selection, *position);
+    *position = row + 1;
+    return row;
+}
+
+// A field display prints: a column of the table, or of a joined file read at
+// the row matched to each displayed row
+typedef struct {
+    const char *name;
+    const Table *table;
+    const Column *column;
+    const uint32_t *matches;  // NULL for the table's own columns
+} DisplayField;
+
+// Function to list the fields to display: the first field_count fields of
+// the table, then those of each join. Returns NULL if memory ran out.
+static DisplayField *display_fields(const Table *table, const Config *config, int field_count, const DisplayJoin *joins,
+                                    int join_count, int *count) {
+    int total = field_count;
+    for (int j = 0; j < join_count; j++) {
+        total += joins[j].config->valid_fields_count - joins[j].first_field;
+    }
+    DisplayField *fields = malloc((total > 0 ? total : 1) * sizeof(DisplayField));
+    if (fields == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    *count = 0;
+    for (int i = 0; i < field_count; i++) {
+        DisplayField field = { config->valid_fields[i], table, &table->columns[i], NULL };
+        fields[(*count)++] = field;
+    }
+    for (int j = 0; j < join_count; j++) {
+        const DisplayJoin *join = &joins[j];
+        for (int i = join->first_field; i < join->config->valid_fields_count; i++) {
+            DisplayField field = { join->config->valid_fields[i], join->table, &join->table->columns[i], join->matches };
+            fields[(*count)++] = field;
+        }
+    }
+    return fields;
+}
+
+// Function to display the rows in the original text format. The fields of
+// joined files follow the table's as "name: value" lines, before the blank
+// line that ends each row.
+static void display_human(Output *output, const Table *table, const Selection *selection, const uint32_t *rows, int row_count,
+                          const Config *config, int field_count, const DisplayField *fields, int total) {
+    Writer *w = &output->writer;
+    DisplayFormat *formats = calloc(field_count > 0 ? field_count : 1, sizeof(DisplayFormat));
+    const char **texts = malloc((field_count > 0 ? field_count : 1) * sizeof(char *));
+    char *last = NULL;
+    int ok = formats != NULL && texts != NULL;
+    for (int i = 0; ok && i < field_count; i++) {
+        texts[i] = config->print_formats[i];
+    }
+    size_t length = ok && field_count > 0 ? strlen(texts[field_count - 1]) : 0;
+    if (ok && total > field_count && length >= 2 && strcmp(texts[field_count - 1] + length - 2, "\n\n") == 0) {
+        last = malloc(length);
+        ok = last != NULL;
+        if (ok) {
+            memcpy(last, texts[field_count - 1], length - 1);
+            last[length - 1] = '\0';
+            texts[field_count - 1] = last;
+        }
+    }
+    for (int i = 0; ok && i < field_count; i++) {
+        ok = split_format(texts[i], table->columns[i].type, &formats[i]);
+    }
+
+    int position = 0;
+    for (int row = next_row(selection, rows, row_count, &position); ok && row >= 0;
+         row = next_row(selection, rows, row_count, &position)) {
+        for (int i = 0; i < field_count; i++) {
+            const Column *column = &table->columns[i];
+            const DisplayFormat *format = &formats[i];
+            if (format->conversion == 0) {
+                switch (column->type) {
+                    case FIELD_STRING: writer_printf(w, texts[i], column_string(table, column, row)); break;
+                    case FIELD_FLOAT: writer_printf(w, texts[i], column->floats[row]); break;
+                    case FIELD_INT: writer_printf(w, texts[i], column->ints[row]); break;
+                }
+                continue;
+            }
+            writer_string(w, format->prefix);
+            switch (column->type) {
+                case FIELD_STRING: writer_string(w, column_string(table, column, row)); break;
+                case FIELD_FLOAT: writer_fixed(w, column->floats[row]); break;
+                case FIELD_INT: writer_int(w, column->ints[row]); break;
+            }
+            writer_string(w, format->suffix);
+        }
+        for (int i = field_count; i < total; i++) {
+            const DisplayField *field = &fields[i];
+            int match = (int)field->matches[row];
+            writer_string(w, field->name);
+            writer_string(w, ": ");
+            switch (field->column->type) {
+                case FIELD_STRING: writer_string(w, column_string(field->table, field->column, match)); break;
+                case FIELD_FLOAT: writer_fixed(w, field->column->floats[match]); break;
+                case FIELD_INT: writer_int(w, field->column->ints[match]); break;
+            }
+            writer_char(w, '\n');
+        }
+        if (last != NULL) {
+            writer_char(w, '\n');
+        }
+    }
+
+    for (int i = 0; formats != NULL && i < field_count; i++) {
+        free(formats[i].prefix);
+        free(formats[i].suffix);
+    }
+    free(formats);
+    free(texts);
+    free(last);
+}
+
+// Function to escape the JSON keys of the displayed fields once, as
+// ", \"name\": " for each field. Returns a malloc'd buffer holding them one
+// after the other, with field i's at offsets[i] up to offsets[i + 1], or NULL.
+static char *json_keys(const DisplayField *fields, int field_count, size_t *offsets) {
+    char *keys = NULL;
+    size_t size = 0;
+    FILE *file = open_memstream(&keys, &size);
+    Writer w;
+    if (file == NULL || !writer_init(&w, file)) {
+        if (file != NULL) fclose(file);
+        free(keys);
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    for (int i = 0; i < field_count; i++) {
+        offsets[i] = w.length;
+        writer_string(&w, ", ");
+        json_text(&w, fields[i].name);
+        writer_string(&w, ": ");
+    }
+    offsets[field_count] = w.length;
+    int complete = w.length < w.capacity;  // Nothing was flushed early
+    writer_free(&w);
+    if (fclose(file) != 0 || !complete) {
+        free(keys);
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    return keys;
+}
+
+void output_display(Output *output, const Table *table, const Selection *selection, const uint32_t *rows, int row_count,
+                    const Config *config, int field_count, const DisplayJoin *joins, int join_count) {
+    Writer *w = &output->writer;
+    int total;
+    DisplayField *fields = display_fields(table, config, field_count, joins, join_count, &total);
+    if (fields == NULL) {
+        return;
+    }
+    if (output->format == OUTPUT_HUMAN) {
+        display_human(output, table, selection, rows, row_count, config, field_count, fields, total);
+        free(fields);
+        return;
+    }
+
+    char *keys = NULL;
+    size_t *offsets = NULL;
+    if (output->format == OUTPUT_JSONL) {
+        offsets = malloc((total + 1) * sizeof(size_t));
+        keys = offsets != NULL ? json_keys(fields, total, offsets) : NULL;
+        if (keys == NULL) {
+            free(offsets);
+            free(fields);
+            return;
+        }
+    }
+
+    // Header: field names, with their types in binary
+    switch (output->format) {
+        case OUTPUT_CSV:
+            for (int i = 0; i < total; i++) {
+                if (i > 0) writer_char(w, ',');
+                csv_text(w, fields[i].name);
+            }
+            writer_char(w, '\n');
+            break;
+        case OUTPUT_BINARY:
+            writer_char(w, 'H');
+            put_u16(w, (uint32_t)total);
+            for (int i = 0; i < total; i++) {
+                writer_char(w, (char)fields[i].column->type);
+                put_text(w, fields[i].name);
+            }
+            break;
+        default:
+            break;
+    }
+
+    int position = 0;
+    for (int row = next_row(selection, rows, row_count, &position); row >= 0; row = next_row(selection, rows, row_count, &position)) {
+        if (output->format == OUTPUT_JSONL) {
+            writer_string(w, "{\"op\": \"display\"");
+        } else if (output->format == OUTPUT_BINARY) {
+            writer_char(w, 'R');
+        }
+        for (int i = 0; i < total; i++) {
+            const Table *source = fields[i].table;
+            const Column *column = fields[i].column;
+            int at = fields[i].matches != NULL ? (int)fields[i].matches[row] : row;
+            switch (output->format) {
+                case OUTPUT_CSV:
+                    if (i > 0) writer_char(w, ',');
+                    if (column->type == FIELD_STRING) {
+                        csv_text(w, column_string(source, column, at));
+                    } else if (column->type == FIELD_INT) {
+                        writer_int(w, column->ints[at]);
+                    } else if (!isnan(column->floats[at])) {
+                        writer_float(w, column->floats[at]);
+                    }
+                    break;
+                case OUTPUT_JSONL:
+                    writer_bytes(w, keys + offsets[i], offsets[i + 1] - offsets[i]);
+                    if (column->type == FIELD_STRING) {
+                        json_text(w, column_string(source, column, at));
+                    } else if (column->type == FIELD_INT) {
+                        writer_int(w, column->ints[at]);
+                    } else if (isfinite(column->floats[at])) {
+                        writer_float(w, column->floats[at]);
+                    } else {
+                        writer_string(w, "null");
+                    }
+                    break;
+                default:
+                    if (column->type == FIELD_STRING) {
+                        put_text(w, column_string(source, column, at));
+                    } else if (column->type == FIELD_INT) {
+                        put_u32(w, (uint32_t)column->ints[at]);
+                    } else {
+                        put_f32(w, column->floats[at]);
+                    }
+                    break;
+            }
+        }
+        if (output->format == OUTPUT_JSONL) {
+            writer_string(w, "}\n");
+        } else if (output->format == OUTPUT_CSV) {
+            writer_char(w, '\n');
+        }
+    }
+    free(keys);
+    free(offsets);
+    free(fields);
+}
@@ -0,0 +1,84 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "table.h"
+#include "writer.h"
+
+// Formats results and displayed rows can be written in
+typedef enum {
+    OUTPUT_HUMAN,   // The original text lines
+    OUTPUT_CSV,     // A table of results, then a table of displayed rows
+    OUTPUT_JSONL,   // One JSON object per result and per displayed row
+    OUTPUT_BINARY   // Tagged little-endian records, see README.md
+} OutputFormat;
+
+// Magic bytes at the start of binary output
+#define OUTPUT_BINARY_MAGIC "CDR1"
+
+// Where the results of a run go. Results and rows are written to out in the
+// chosen format; error messages always go to err as text (into the same
+// buffer when err is the output stream).
+typedef struct {
+    Writer writer;
+    FILE *err;
+    OutputFormat format;
+    int results_header;  // CSV: the header of the results table was written
+} Output;
+
+// Look up a format by name ("human", "csv", "jsonl" or "binary"). Returns 0
+// if there is no such format.
+int output_format(const char *name, OutputFormat *format);
+
+int output_init(Output *output, FILE *out, FILE *err, OutputFormat format);
+
+// Flush and release the buffer; the streams stay open
+void output_free(Output *output);
+
+// The results of the operations. states is one state code, or several
+// separated by commas for a filter that keeps any of them. group_by is the
+// name of the field a grouped aggregate is grouped by, with group the value
+// of the group, or NULL for a total over all selected rows.
+void output_loaded(Output *output, int rows);
+void output_filter_state(Output *output, const char *states, int rows);
+void output_filter(Output *output, const char *field, const char *comparison, double operand, int rows);
+
+// A filter of several comparisons: text is how it reads to a person, exact
+// the comparisons as written with operands that read back exactly
+void output_filter_expression(Output *output, const char *text, const char *exact, int rows);
+// A top keeping up to limit rows, and a sort, in the order of a field
+void output_top(Output *output, const char *field, int limit, int descending, int rows);
+void output_sort(Output *output, const char *field, int descending, int rows);
+
+// A join of a file on its key fields (separated by commas)
+void output_join(Output *output, const char *file, const char *keys, int rows);
+
+void output_population_total(Output *output, const char *group_by, const char *group, int64_t population);
+void output_population(Output *output, const char *field, const char *group_by, const char *group, double population);
+
+// A percentage; pass a total population of 0 when it cannot be computed
+void output_percent(Output *output, const char *field, const char *group_by, const char *group, int64_t total, double percentage);
+
+// A message for a line of the operations file. Errors go to the error stream.
+void output_message(Output *output, const char *text, int error);
+
+// Fields of a joined file that display prints after the table's own: the
+// fields of config from first_field on, for each displayed row of the table
+// the values of row matches[row] of table
+typedef struct {
+    const Table *table;
+    const Config *config;
+    const uint32_t *matches;
+    int first_field;
+} DisplayJoin;
+
+// The selected rows, with the first field_count fields of each and then the
+// fields of the join_count joins: the row_count rows of rows in that order,
+// or in row order if rows is NULL. Every displayed row must have a match in
+// each join.
+void output_display(Output *output, const Table *table, const Selection *selection, const uint32_t *rows, int row_count,
+                    const Config *config, int field_count, const DisplayJoin *joins, int join_count);
+
+#endif
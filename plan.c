@@ -0,0 +1,1618 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
+#include <pthread.h>
+
+#include "plan.h"
+#include "index.h"
+#include "group.h"
+#include "cache.h"
+#include "sort.h"
+#include "join.h"
+
+// A filter is answered from its column's index when it keeps at most one row
+// in INDEX_SELECTIVITY; otherwise scanning the column is as fast
+#define INDEX_SELECTIVITY 16
+
+// Words of rows in each block of a pass (4096 rows). Sub-populations are
+// summed per block, and the block sums are added up with compensation.
+#define AGGREGATE_BLOCK_WORDS 64
+
+// Result of one operation after its pass over the data
+typedef struct {
+    int count;            // Filters: rows selected after the filter
+    int64_t population;   // population-total and percent: total population
+    CompensatedSum sub;   // population: and percent: sub-population
+    GroupTable groups;    // Grouped aggregates: the totals of each group
+} OpResult;
+
+// Function to strip leading and trailing spaces from a string
+void strip_spaces(char *str) {
+    char *end;
+
+    // Trim leading spaces
+    while (isspace((unsigned char)*str)) str++;
+
+    // Trim trailing spaces
+    end = str + strlen(str) - 1;
+    while (end > str && isspace((unsigned char)*end)) end--;
+    *(end + 1) = '\0';
+}
+
+// Function to append an operation to the plan
+static Operation *add_operation(Plan *plan, OpType type) {
+    if (plan->count == plan->capacity) {
+        int capacity = plan->capacity ? plan->capacity * 2 : 16;
+        Operation *ops = realloc(plan->ops, capacity * sizeof(Operation));
+        if (ops == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return NULL;
+        }
+        plan->ops = ops;
+        plan->capacity = capacity;
+    }
+
+    Operation *op = &plan->ops[plan->count++];
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    op->column = -1;
+    op->group_column = -1;
+    return op;
+}
+
+static int add_message(Plan *plan, int error, const char *text) {
+    Operation *op = add_operation(plan, OP_MESSAGE);
+    if (op == NULL) return 0;
+    op->error = error;
+    snprintf(op->field, sizeof(op->field), "%s", text);
+    return 1;
+}
+
+// Function to find a field among the table's and then among the fields of
+// the files joined so far that are not keys. Returns its column in the plan
+// and sets *type, or returns -1.
+static int plan_field(const Plan *plan, const Config *config, const char *field, FieldType *type) {
+    int column = find_field(config, field);
+    if (column != -1) {
+        *type = config->field_types[column];
+        return column;
+    }
+    for (int j = 0; j < plan->join_count; j++) {
+        const Join *join = &plan->joins[j];
+        if (join->failed) {
+            continue;  // Has no fields
+        }
+        if (!join->open) {
+            // Compiled without a table, so the file's header was not read:
+            // the field may be one of its columns, all of which are floats
+            *type = FIELD_FLOAT;
+            return join->first_column + join->key_count;
+        }
+        column = find_field(&join->config, field);
+        if (column >= join->key_count) {
+            *type = join->config.field_types[column];
+            return join->first_column + column;
+        }
+    }
+    return -1;
+}
+
+// Function to compile one comparison of a filter line, "field:comparison:
+// number" or "field:between:low:high". Returns NULL if the term is fine, or
+// the message to report instead of the filter.
+static const char *compile_term(Predicate *term, char *text, const Plan *plan, const Config *config, char *message, size_t size) {
+    char field[100] = "", comparison[8] = "";
+    double number = 0, high = 0;
+    while (isspace((unsigned char)*text)) text++;
+    strip_spaces(text);
+    int parts = sscanf(text, "%99[^:]:%7[^:]:%lf:%lf", field, comparison, &number, &high);
+    if ((strcmp(field, "County") == 0) || (strcmp(field, "State") == 0)) {
+        return "Not a valid field.";
+    }
+    FieldType type;
+    int column = plan_field(plan, config, field, &type);
+    if (column == -1) {
+        snprintf(message, size, "Field not found: %s\n", field);
+        return message;
+    }
+    int between = strcmp(comparison, "between") == 0;
+    int known = between || strcmp(comparison, "ge") == 0 || strcmp(comparison, "gt") == 0
+                || strcmp(comparison, "le") == 0 || strcmp(comparison, "lt") == 0 || strcmp(comparison, "eq") == 0;
+    if (!known || parts < (between ? 4 : 3)) {
+        return "";  // Unknown comparison or missing number: reported as an invalid line
+    }
+
+    strcpy(term->field, field);
+    strcpy(term->comparison, comparison);
+    term->column = column;
+    term->number = number;
+    term->high = high;
+    if (strcmp(comparison, "eq") == 0) {
+        // Values of a float column equal to the number as it would be loaded
+        double value = type == FIELD_FLOAT && fabs(number) <= FLT_MAX ? (float)number : number;
+        term->kernels[0] = find_mask_kernel(type, "ge", value, &term->args[0]);
+        term->kernels[1] = find_mask_kernel(type, "le", value, &term->args[1]);
+    } else if (between) {
+        term->kernels[0] = find_mask_kernel(type, "ge", number, &term->args[0]);
+        term->kernels[1] = find_mask_kernel(type, "le", high, &term->args[1]);
+    } else {
+        term->kernels[0] = find_mask_kernel(type, comparison, number, &term->args[0]);
+        term->kernels[1] = NULL;
+    }
+    return NULL;
+}
+
+// Estimated share of the rows a term keeps, or -1 if there is no estimate
+static double term_share(const Predicate *term, const Table *table) {
+    const ColumnStats *stats = column_stats(table, term->column);
+    if (stats == NULL) {
+        return -1;
+    }
+    const char *c = term->comparison;
+    double low = -INFINITY, high = INFINITY;
+    if (strcmp(c, "ge") == 0 || strcmp(c, "gt") == 0) {
+        low = term->number;
+    } else if (strcmp(c, "le") == 0 || strcmp(c, "lt") == 0) {
+        high = term->number;
+    } else if (strcmp(c, "eq") == 0) {
+        low = high = term->number;
+    } else {  // between
+        low = term->number;
+        high = term->high;
+    }
+    return stats_share(stats, table->row_count, low, high);
+}
+
+// Order in which to evaluate things: by rank, highest first, then as written
+typedef struct {
+    double rank;
+    int index;
+} Ranked;
+
+static int compare_ranked(const void *a, const void *b) {
+    const Ranked *x = a, *y = b;
+    if (x->rank != y->rank) return x->rank > y->rank ? -1 : 1;
+    return x->index - y->index;
+}
+
+// Function to choose the order a filter's terms are evaluated in. Terms
+// cost one scan per kernel. Within a group, the terms that rule out the most
+// rows per scan go first, so the rest of the group only runs on words that
+// still have rows; groups that keep the most rows per scan go first, so the
+// later groups only test the rows no earlier group kept. Without a table
+// (or statistics) the terms are evaluated as written.
+static void order_terms(Operation *op, const Table *table) {
+    Ranked terms[MAX_TERMS], groups[MAX_TERMS];
+    double group_share[MAX_TERMS], group_cost[MAX_TERMS];
+    int group_count = op->terms[op->term_count - 1].group + 1;
+    int estimated = table != NULL && op->term_count > 1;
+
+    for (int g = 0; g < group_count; g++) {
+        group_share[g] = 1.0;
+        group_cost[g] = 0.0;
+    }
+    for (int t = 0; t < op->term_count; t++) {
+        const Predicate *term = &op->terms[t];
+        double share = estimated ? term_share(term, table) : -1;
+        double cost = term->kernels[1] != NULL ? 2.0 : 1.0;
+        estimated = estimated && share >= 0;
+        terms[t].rank = (1.0 - share) / cost;
+        terms[t].index = t;
+        group_share[term->group] *= share;
+        group_cost[term->group] += cost;
+    }
+    for (int g = 0; g < group_count; g++) {
+        groups[g].rank = group_share[g] / group_cost[g];
+        groups[g].index = g;
+    }
+    if (!estimated) {
+        for (int t = 0; t < op->term_count; t++) op->order[t] = (unsigned char)t;
+        return;
+    }
+
+    qsort(groups, group_count, sizeof(Ranked), compare_ranked);
+    qsort(terms, op->term_count, sizeof(Ranked), compare_ranked);
+    int count = 0;
+    for (int g = 0; g < group_count; g++) {
+        for (int t = 0; t < op->term_count; t++) {
+            if (op->terms[terms[t].index].group == groups[g].index) {
+                op->order[count++] = (unsigned char)terms[t].index;
+            }
+        }
+    }
+}
+
+// Function to compile a filter line: comparisons joined by "&&" (all of
+// them) and "||" (any of the groups of them), with && binding tighter
+static int compile_filter(Plan *plan, char *line, int line_number, const Table *table, const Config *config) {
+    char expression[2048], message[128];
+    Predicate terms[MAX_TERMS];
+    int term_count = 0, group = 0;
+    snprintf(expression, sizeof(expression), "%s", strstr(line, "filter:") == line ? line + strlen("filter:") : "");
+
+    char *rest = expression;
+    while (rest != NULL) {
+        // Cut out the next term, noting the operator after it
+        char *and = strstr(rest, "&&"), *or = strstr(rest, "||");
+        char *end = and != NULL && (or == NULL || and < or) ? and : or;
+        int next_group = end != NULL && end == or;
+        if (end != NULL) *end = '\0';
+
+        if (term_count == MAX_TERMS) {
+            snprintf(message, sizeof(message), "Error processing line %d: Too many conditions.\n", line_number);
+            return add_message(plan, 1, message);
+        }
+        Predicate *term = &terms[term_count++];
+        memset(term, 0, sizeof(*term));
+        term->group = group;
+        const char *problem = compile_term(term, rest, plan, config, message, sizeof(message));
+        if (problem != NULL && problem[0] == '\0') {
+            snprintf(message, sizeof(message), "Error processing line %d: Invalid filter format.\n", line_number);
+            return add_message(plan, 1, message);
+        }
+        if (problem != NULL) {
+            return add_message(plan, problem == message, problem);
+        }
+        group += next_group;
+        rest = end != NULL ? end + 2 : NULL;
+    }
+
+    Operation *op = add_operation(plan, OP_FILTER_FIELD);
+    if (op == NULL) return 0;
+    memcpy(op->terms, terms, term_count * sizeof(Predicate));
+    op->term_count = term_count;
+    op->column = terms[0].column;
+    order_terms(op, table);
+    return 1;
+}
+
+// Function to compile "top:field:k", optionally followed by ":asc" or
+// ":desc" (the default), or "sort:field:asc|desc"
+static int compile_order(Plan *plan, const char *line, int line_number, const Config *config) {
+    int top = strstr(line, "sort:") == NULL;
+    const char *prefix = top ? "top:" : "sort:";
+    const char *text = strstr(line, prefix) == line ? line + strlen(prefix) : "";
+    char field[100] = "", direction[8] = "", message[128];
+    int limit = 0;
+    int valid = top ? sscanf(text, "%99[^:]:%d:%7s", field, &limit, direction) >= 2 && limit >= 0
+                    : sscanf(text, "%99[^:]:%7s", field, direction) == 2;
+
+    int column = find_field(config, field);
+    if (column == -1) {
+        snprintf(message, sizeof(message), "Field not found: %s\n", field);
+        return add_message(plan, 1, message);
+    }
+    if (!valid || (strcmp(direction, "asc") != 0 && strcmp(direction, "desc") != 0 && (!top || direction[0] != '\0'))) {
+        snprintf(message, sizeof(message), "Error processing line %d: Invalid %s format.\n", line_number, top ? "top" : "sort");
+        return add_message(plan, 1, message);
+    }
+
+    Operation *op = add_operation(plan, top ? OP_TOP : OP_SORT);
+    if (op == NULL) return 0;
+    op->column = column;
+    op->limit = limit;
+    op->descending = strcmp(direction, "asc") != 0;
+    strcpy(op->field, field);
+    plan->order = plan->count - 1;
+    return 1;
+}
+
+// Function to compile "join:file:key,key": find the key fields in the table
+// and, with a table, open the file and find them in its header. The file's
+// fields then follow those of the table and of the earlier joins. A join
+// whose keys or file are not found is reported, and still compiled as a
+// failed join so that it keeps no rows.
+static int compile_join(Plan *plan, const char *line, int line_number, const Table *table, const Config *config) {
+    const char *text = line + strlen("join:");
+    const char *colon = strrchr(text, ':');
+    char message[128];
+    if (colon == NULL || colon == text || colon - text >= (int)sizeof(plan->joins[0].file) || colon[1] == '\0'
+        || plan->join_count == MAX_JOINS) {
+        snprintf(message, sizeof(message), "Error processing line %d: Invalid join format.\n", line_number);
+        return add_message(plan, 1, message);
+    }
+    if (plan->joins == NULL && (plan->joins = calloc(MAX_JOINS, sizeof(Join))) == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+
+    Join *join = &plan->joins[plan->join_count];
+    memset(join, 0, sizeof(*join));
+    snprintf(join->file, sizeof(join->file), "%.*s", (int)(colon - text), text);
+    for (const char *list = colon + 1; list != NULL; list = strchr(list, ',') != NULL ? strchr(list, ',') + 1 : NULL) {
+        if (join->key_count == MAX_JOIN_KEYS) {
+            snprintf(message, sizeof(message), "Error processing line %d: Invalid join format.\n", line_number);
+            return add_message(plan, 1, message);
+        }
+        char *key = join->keys[join->key_count];
+        while (isspace((unsigned char)*list)) list++;
+        size_t length = strcspn(list, ",");
+        snprintf(key, sizeof(join->keys[0]), "%.*s", (int)(length < sizeof(join->keys[0]) ? length : sizeof(join->keys[0]) - 1), list);
+        strip_spaces(key);
+        int column = find_field(config, key);
+        if (column == -1 && !join->failed) {
+            snprintf(message, sizeof(message), "Field not found: %s\n", key);
+            join->failed = 1;
+        }
+        join->key_names[join->key_count] = key;
+        join->key_types[join->key_count] = column >= 0 ? config->field_types[column] : FIELD_FLOAT;
+        join->key_columns[join->key_count++] = column;
+    }
+    const Join *previous = plan->join_count > 0 ? &plan->joins[plan->join_count - 1] : NULL;
+    join->first_column = previous != NULL ? previous->first_column + previous->config.valid_fields_count
+                                          : config->valid_fields_count;
+
+    if (table != NULL && !join->failed) {
+        const char *error;
+        if (!config_init(&join->config, join->key_names, join->key_formats, join->key_types, join->key_count)) {
+            return 0;
+        }
+        if (!open_demographics_file(join->file, &join->input, &join->config, &error)) {
+            snprintf(message, sizeof(message), "%s: %.80s\n", error, join->file);
+            config_free(&join->config);
+            join->failed = 1;
+        } else {
+            join->open = 1;
+            for (int k = 0; k < join->key_count && !join->failed; k++) {
+                if (join->input.field_indices[k] < 0) {
+                    snprintf(message, sizeof(message), "Field not found in %.40s: %.60s\n", join->file, join->keys[k]);
+                    close_demographics_file(&join->input);
+                    config_free(&join->config);
+                    join->open = 0;
+                    join->failed = 1;
+                }
+            }
+        }
+    }
+    if (join->failed && !add_message(plan, 1, message)) {
+        return 0;
+    }
+
+    Operation *op = add_operation(plan, OP_JOIN);
+    if (op == NULL) {
+        if (join->open) {
+            close_demographics_file(&join->input);
+            config_free(&join->config);
+        }
+        return 0;
+    }
+    op->join = plan->join_count++;
+    for (int k = 0; k < join->key_count; k++) {
+        size_t length = strlen(op->field);
+        snprintf(op->field + length, sizeof(op->field) - length, "%s%s", k > 0 ? "," : "", join->keys[k]);
+    }
+    return 1;
+}
+
+// Function to compile one line of an operations file
+static int compile_line(Plan *plan, char *line, int line_number, const Table *table, const Config *config) {
+    Operation *op;
+
+    if (strstr(line, "join:") == line) {
+        return compile_join(plan, line, line_number, table, config);
+    } else if (strstr(line, "display")) {
+        plan->display = 1;
+    } else if (strstr(line, "group-by:")) {
+        char field[100] = "";
+        sscanf(line, "group-by:%99[^\n]", field);
+        // A bare "group-by:" goes back to totals over all selected rows
+        int column = field[0] == '\0' ? -1 : find_field(config, field);
+        if (field[0] != '\0' && column == -1) {
+            char message[128];
+            snprintf(message, sizeof(message), "Field not found: %s\n", field);
+            return add_message(plan, 1, message);
+        }
+        plan->group_column = column;
+    } else if (strstr(line, "filter-state:")) {
+        // One state code, or several separated by commas (any of them)
+        if ((op = add_operation(plan, OP_FILTER_STATE)) == NULL) return 0;
+        const char *list = strstr(line, "filter-state:") == line ? line + strlen("filter-state:") : "";
+        op->column = find_field(config, "State");
+        while (op->state_count < MAX_STATES) {
+            char code[3] = "";
+            sscanf(list, "%2s", code);
+            snprintf(op->states[op->state_count], sizeof(op->states[0]), "%.*s", (int)strcspn(code, ","), code);
+            op->state_ids[op->state_count] = table != NULL ? string_pool_find(&table->strings, op->states[op->state_count],
+                                                                              strlen(op->states[op->state_count]))
+                                                           : STRING_POOL_NONE;
+            op->state_count++;
+            list = strchr(list, ',');
+            if (list == NULL) break;
+            list++;
+        }
+        for (int i = 0; i < op->state_count; i++) {
+            size_t length = strlen(op->field);
+            snprintf(op->field + length, sizeof(op->field) - length, "%s%s", i > 0 ? "," : "", op->states[i]);
+        }
+    } else if (strstr(line, "filter:")) {
+        return compile_filter(plan, line, line_number, table, config);
+    } else if (strstr(line, "top:") || strstr(line, "sort:")) {
+        return compile_order(plan, line, line_number, config);
+    } else if (strstr(line, "population-total")) {
+        if ((op = add_operation(plan, OP_POPULATION_TOTAL)) == NULL) return 0;
+        op->group_column = plan->group_column;
+    } else if (strstr(line, "population:") || strstr(line, "percent:")) {
+        int percent = strstr(line, "population:") == NULL;
+        char field[100] = "";
+        sscanf(line, percent ? "percent:%99[^\n]" : "population:%99[^\n]", field);
+        if (!percent && ((strcmp(field, "County") == 0) || (strcmp(field, "State") == 0)
+            || (strcmp(field, "Income.Per Capita Income") == 0)
+            || (strcmp(field, "Income.Median Household Income") == 0)
+            || (strcmp(field, POPULATION_FIELD) == 0))) {
+            return add_message(plan, 0, "Not a viable field for this.");
+        }
+
+        if ((op = add_operation(plan, percent ? OP_PERCENT_FIELD : OP_POPULATION_FIELD)) == NULL) return 0;
+        op->group_column = plan->group_column;
+        strcpy(op->field, field);
+        // Sub-populations can only be computed from percentage columns
+        FieldType type;
+        int column = plan_field(plan, config, field, &type);
+        if (column != -1 && type == FIELD_FLOAT) {
+            op->column = column;
+        }
+    } else {
+        char message[128];
+        snprintf(message, sizeof(message), "Error processing line %d: Invalid filter format.\n", line_number);
+        return add_message(plan, 1, message);
+    }
+    return 1;
+}
+
+int plan_compile(Plan *plan, FILE *file, const Table *table, const Config *config) {
+    char line[2048];
+    int line_number = 0;
+
+    memset(plan, 0, sizeof(*plan));
+    plan->group_column = -1;
+    plan->order = -1;
+
+    // Read the operations file line by line
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        strip_spaces(line);  // Strip any leading/trailing spaces
+
+        if (strlen(line) == 0) {
+            // Skip empty lines
+            continue;
+        }
+        int first = plan->count;
+        if (!compile_line(plan, line, line_number, table, config)) {
+            plan_free(plan);
+            return 0;
+        }
+        for (int i = first; i < plan->count; i++) {
+            plan->ops[i].line = line_number;
+        }
+    }
+    return 1;
+}
+
+static int is_filter(const Operation *op) {
+    return op->type == OP_FILTER_STATE || op->type == OP_FILTER_FIELD;
+}
+
+static int is_order(const Operation *op) {
+    return op->type == OP_TOP || op->type == OP_SORT;
+}
+
+// Operations that need every row before them settled
+static int stands_alone(const Operation *op) {
+    return is_order(op) || op->type == OP_JOIN;
+}
+
+void plan_columns(const Plan *plan, const Config *config, unsigned char *columns) {
+    int population = find_field(config, POPULATION_FIELD);
+    for (int i = 0; i < plan->count; i++) {
+        const Operation *op = &plan->ops[i];
+        if (op->type == OP_MESSAGE) continue;
+        // Columns past the table's are those of joined files
+        if (op->column >= 0 && op->column < config->valid_fields_count) columns[op->column] = 1;
+        for (int t = 0; t < op->term_count; t++) {
+            if (op->terms[t].column < config->valid_fields_count) columns[op->terms[t].column] = 1;
+        }
+        for (int k = 0; op->type == OP_JOIN && !plan->joins[op->join].failed && k < plan->joins[op->join].key_count; k++) {
+            columns[plan->joins[op->join].key_columns[k]] = 1;
+        }
+        if (op->group_column >= 0) columns[op->group_column] = 1;
+        if (!is_filter(op) && !stands_alone(op) && population >= 0) columns[population] = 1;
+    }
+    // display prints every required field
+    for (int i = 0; plan->display && i < config->required_count; i++) {
+        columns[i] = 1;
+    }
+}
+
+int needed_columns(const char *operations_file, const Config *config, unsigned char *columns) {
+    FILE *file = fopen(operations_file, "r");
+    if (file == NULL) {
+        return 1;  // Reported when the operations are run
+    }
+    Plan plan;
+    int ok = plan_compile(&plan, file, NULL, config);
+    if (ok) {
+        plan_columns(&plan, config, columns);
+        plan_free(&plan);
+    }
+    fclose(file);
+    return ok;
+}
+
+void plan_free(Plan *plan) {
+    for (int j = 0; j < plan->join_count; j++) {
+        if (plan->joins[j].open) {
+            close_demographics_file(&plan->joins[j].input);
+            config_free(&plan->joins[j].config);
+        }
+    }
+    free(plan->joins);
+    free(plan->ops);
+    memset(plan, 0, sizeof(*plan));
+}
+
+// Function to narrow [low, high] to the keys a filter kernel would keep.
+// Zero keeps both signs, and NaNs, which never compare true, lie outside the
+// infinities. Returns 0 for kernels the index cannot answer.
+static int kernel_keys(MaskKernel kernel, const KernelArg *arg, uint32_t *low, uint32_t *high) {
+    const Kernels *k = kernels();
+    uint32_t from = 0, to = UINT32_MAX;
+    if (kernel == k->float_ge) {
+        from = index_float_key(arg->f == 0 ? -0.0f : arg->f);
+        to = index_float_key(INFINITY);
+    } else if (kernel == k->float_le) {
+        from = index_float_key(-INFINITY);
+        to = index_float_key(arg->f == 0 ? 0.0f : arg->f);
+    } else if (kernel == k->int_gt) {
+        from = index_int_key(arg->i) + 1;  // arg.i < INT_MAX, see find_mask_kernel
+    } else if (kernel == k->int_le) {
+        to = index_int_key(arg->i);
+    } else {
+        return 0;
+    }
+    if (from > *low) *low = from;
+    if (to < *high) *high = to;
+    return 1;
+}
+
+// Function to look up the rows a filter of one comparison keeps in its
+// column's index. Returns the number of rows, or -1 if there is no index to
+// use.
+static int indexed_rows(const Operation *op, const Table *table, const uint32_t **rows) {
+    // Checked first: asking for the index counts as a use toward building it
+    if (op->term_count != 1) return -1;
+    const ColumnIndex *index = column_index(table, op->column);
+    if (index == NULL) return -1;
+
+    const Predicate *term = &op->terms[0];
+    uint32_t low = 0, high = UINT32_MAX;
+    for (int i = 0; i < 2 && term->kernels[i] != NULL; i++) {
+        if (!kernel_keys(term->kernels[i], &term->args[i], &low, &high)) return -1;
+    }
+    if (low > high) {
+        *rows = NULL;
+        return 0;
+    }
+    return index_key_rows(index, &table->columns[op->column], table->row_count, low, high, rows);
+}
+
+// Function to build the bitmap of the rows a selective filter keeps from its
+// column's index. Returns NULL if the filter is better answered by a scan.
+static uint64_t *index_bitmap(const Operation *op, const Table *table) {
+    const uint32_t *rows[MAX_STATES];
+    int counts[MAX_STATES], lists = 0;
+    int64_t total = 0;
+    if (op->type == OP_FILTER_STATE) {
+        const ColumnIndex *index = column_index(table, op->column);
+        if (index == NULL) return NULL;
+        for (lists = 0; lists < op->state_count; lists++) {
+            counts[lists] = index_string_rows(table, index, op->state_ids[lists], &rows[lists]);
+            total += counts[lists];
+        }
+    } else {
+        counts[0] = indexed_rows(op, table, &rows[0]);
+        if (counts[0] < 0) return NULL;
+        total = counts[0];
+        lists = 1;
+    }
+    if (total * INDEX_SELECTIVITY > table->row_count) {
+        return NULL;
+    }
+
+    uint64_t *bitmap = calloc(SELECTION_WORDS(table->row_count) + 1, sizeof(uint64_t));
+    if (bitmap == NULL) {
+        return NULL;
+    }
+    for (int l = 0; l < lists; l++) {
+        for (int i = 0; i < counts[l]; i++) {
+            bitmap[rows[l][i] / 64] |= UINT64_C(1) << (rows[l][i] % 64);
+        }
+    }
+    return bitmap;
+}
+
+// The rows of a joined file and the row of it each row of the table matched
+typedef struct {
+    Table table;
+    uint32_t *matches;  // JOIN_NONE for rows that matched nothing; NULL if the join failed
+    int first_column;   // Column of the plan its first column is
+} JoinedRows;
+
+// The files joined so far, in the order of the plan's joins
+typedef struct {
+    JoinedRows rows[MAX_JOINS];
+    int count;
+} JoinedTables;
+
+// Function to find the values of a column for the rows rows of a word from
+// first_row on. The table's own columns are read in place; the values of a
+// joined file's column are copied into buffer from the rows matched to the
+// word's rows, with zero for rows that matched nothing.
+static const void *word_values(const Table *table, const JoinedTables *joined, int column, int first_row, int rows, void *buffer) {
+    if (joined == NULL || joined->count == 0 || column < joined->rows[0].first_column) {
+        return (const uint32_t *)column_data(&table->columns[column]) + first_row;
+    }
+    const JoinedRows *join = &joined->rows[0];
+    for (int j = 1; j < joined->count && column >= joined->rows[j].first_column; j++) {
+        join = &joined->rows[j];
+    }
+    const uint32_t *values = column_data(&join->table.columns[column - join->first_column]);
+    for (int i = 0; i < rows; i++) {
+        uint32_t match = join->matches != NULL ? join->matches[first_row + i] : JOIN_NONE;
+        if (match != JOIN_NONE) {
+            memcpy((uint32_t *)buffer + i, values + match, sizeof(uint32_t));
+        } else {
+            memset((uint32_t *)buffer + i, 0, sizeof(uint32_t));
+        }
+    }
+    return buffer;
+}
+
+// Function to apply a filter's terms to the selected rows of a word, in the
+// order chosen by order_terms. Each group only looks at the rows no earlier
+// group kept, and each term only at the rows the group still has.
+static uint64_t filter_terms(const Operation *op, const Table *table, const JoinedTables *joined, int first_row, int rows,
+                             uint64_t bits) {
+    uint32_t buffer[64];
+    uint64_t kept = 0, matched = bits;
+    for (int i = 0; i < op->term_count; i++) {
+        const Predicate *term = &op->terms[op->order[i]];
+        if (i > 0 && term->group != op->terms[op->order[i - 1]].group) {
+            // A new group: the last one is done
+            kept |= matched;
+            if (kept == bits) return kept;
+            matched = bits & ~kept;
+        } else if (matched == 0) {
+            continue;
+        }
+        const uint32_t *values = word_values(table, joined, term->column, first_row, rows, buffer);
+        matched &= term->kernels[0](values, rows, &term->args[0]);
+        if (term->kernels[1] != NULL && matched != 0) {
+            matched &= term->kernels[1](values, rows, &term->args[1]);
+        }
+    }
+    return kept | matched;
+}
+
+// Function to add the selected rows of a word to the groups of a grouped
+// aggregate. Each group sums its rows of the word into four lanes by row
+// position, the way the sum_sub_population kernels do, so a group's totals
+// are exactly what filtering on its key would give.
+static int add_word_groups(const Operation *op, OpResult *result, const Table *table, const JoinedTables *joined,
+                           const int *population, uint64_t bits, int first_row) {
+    GroupTable *groups = &result->groups;
+    uint32_t word = ++groups->words;
+    int totals = op->type == OP_POPULATION_TOTAL || op->type == OP_PERCENT_FIELD;
+    int rows = table->row_count - first_row < 64 ? table->row_count - first_row : 64;
+    float buffer[64];
+    const float *percentages = (op->type == OP_POPULATION_FIELD || op->type == OP_PERCENT_FIELD) && op->column >= 0
+                               ? word_values(table, joined, op->column, first_row, rows, buffer) : NULL;
+    uint32_t keys[64];
+    double lanes[64][4];
+    int count = 0;
+
+    for (uint64_t b = bits; b != 0; b &= b - 1) {
+        int row = first_row + __builtin_ctzll(b);
+        uint32_t key = group_key(groups->column, row);
+        GroupTotals *group = group_table_find(groups, key, row);
+        if (group == NULL) {
+            return 0;
+        }
+        if (group->word != word) {
+            group->word = word;
+            group->slot = count;
+            keys[count] = key;
+            memset(lanes[count++], 0, sizeof(lanes[0]));
+        }
+        group->rows++;
+        if (totals) {
+            group->population += population[row];
+        }
+        if (percentages != NULL) {
+            double sub = (percentages[row - first_row] / 100.0) * population[row];
+            if (!isnan(sub)) {
+                lanes[group->slot][row & 3] += sub;  // Unreadable percentages add nothing, as in the kernels
+            }
+        }
+    }
+
+    // The hash table may have grown since a group was found, so find it
+    // again. A group's first word in a block adds up its last block first.
+    for (int i = 0; percentages != NULL && i < count; i++) {
+        GroupTotals *group = group_table_find(groups, keys[i], first_row);
+        if (group == NULL) {
+            return 0;
+        }
+        if (group->block != groups->blocks) {
+            compensated_add(&group->sub, group->block_sub);
+            group->block_sub = 0.0;
+            group->block = groups->blocks;
+        }
+        group->block_sub += (lanes[i][0] + lanes[i][1]) + (lanes[i][2] + lanes[i][3]);
+    }
+    return 1;
+}
+
+// Function to add up the last block of every group of a grouped aggregate
+static void finish_groups(GroupTable *groups) {
+    for (uint32_t i = 0; groups->groups != NULL && i < groups->capacity; i++) {
+        GroupTotals *group = &groups->groups[i];
+        if (group->rows > 0) {
+            compensated_add(&group->sub, group->block_sub);
+            group->block_sub = 0.0;
+        }
+    }
+}
+
+// The rows a segment's pass covers, split into fixed blocks of
+// AGGREGATE_BLOCK_WORDS words, and the share of them one thread evaluates.
+// Filters and totals over all selected rows are evaluated block by block;
+// each block's sub-population sum is kept apart and the sums are added up in
+// block order afterwards, so results do not depend on the number of threads.
+typedef struct {
+    const Operation *ops;
+    const int *filters;        // Indices of the filters, in order
+    int filter_count;
+    const int *aggregates;     // Indices of the aggregates over all selected rows
+    int aggregate_count;
+    uint64_t **indexed;        // Bitmap of each filter from its index, or NULL
+    const Table *table;
+    const JoinedTables *joined;  // Files joined so far, or NULL
+    Selection *selection;
+    const int *population;
+    int first_block;           // Blocks [first_block, last_block) are this range's
+    int last_block;
+    int *counts;               // Per filter: rows it kept in this range
+    int64_t *populations;      // Per aggregate: population of the kept rows
+    double *block_subs;        // Per aggregate and block (shared by all ranges)
+    int block_count;
+} SegmentRange;
+
+static void *run_range(void *arg) {
+    SegmentRange *range = arg;
+    const Operation *ops = range->ops;
+    const Table *table = range->table;
+    Selection *selection = range->selection;
+    const int *population = range->population;
+    const Kernels *k = kernels();
+    int words = SELECTION_WORDS(selection->row_count);
+
+    for (int block = range->first_block; block < range->last_block; block++) {
+        int last_word = (block + 1) * AGGREGATE_BLOCK_WORDS < words ? (block + 1) * AGGREGATE_BLOCK_WORDS : words;
+        for (int w = block * AGGREGATE_BLOCK_WORDS; w < last_word; w++) {
+            uint64_t bits = selection->bits[w];
+            if (bits == 0) continue;
+
+            int first_row = w * 64;
+            int rows = selection->row_count - first_row < 64 ? selection->row_count - first_row : 64;
+            for (int f = 0; f < range->filter_count && bits != 0; f++) {
+                const Operation *op = &ops[range->filters[f]];
+                if (range->indexed != NULL && range->indexed[f] != NULL) {
+                    bits &= range->indexed[f][w];
+                } else if (op->type == OP_FILTER_STATE) {
+                    const Column *column = &table->columns[op->column];
+                    uint64_t kept = 0;
+                    for (uint64_t b = bits; b != 0; b &= b - 1) {
+                        int bit = __builtin_ctzll(b);
+                        uint32_t id = column->strings[first_row + bit];
+                        for (int s = 0; s < op->state_count; s++) {
+                            if (id == op->state_ids[s]) {
+                                kept |= UINT64_C(1) << bit;
+                                break;
+                            }
+                        }
+                    }
+                    bits = kept;
+                } else {
+                    bits = filter_terms(op, table, range->joined, first_row, rows, bits);
+                }
+                range->counts[f] += __builtin_popcountll(bits);
+            }
+            if (range->filter_count > 0) {
+                selection->bits[w] = bits;
+            }
+            if (bits == 0) continue;
+
+            // Masked sums over the surviving rows of the word
+            for (int a = 0; a < range->aggregate_count; a++) {
+                const Operation *op = &ops[range->aggregates[a]];
+                if (op->type == OP_POPULATION_TOTAL || op->type == OP_PERCENT_FIELD) {
+                    range->populations[a] += k->sum_int(population + first_row, bits, rows);
+                }
+                if ((op->type == OP_POPULATION_FIELD || op->type == OP_PERCENT_FIELD) && op->column >= 0) {
+                    float buffer[64];
+                    const float *percentages = word_values(table, range->joined, op->column, first_row, rows, buffer);
+                    range->block_subs[a * range->block_count + block] +=
+                        k->sum_sub_population(percentages, population + first_row, bits, rows);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+// Run fn on every range, one thread per range
+static void run_ranges(SegmentRange *ranges, int range_count, void *(*fn)(void *)) {
+    pthread_t *workers = malloc(range_count * sizeof(pthread_t));
+    int *started = calloc(range_count, sizeof(int));
+    for (int i = 1; workers != NULL && started != NULL && i < range_count; i++) {
+        started[i] = pthread_create(&workers[i], NULL, fn, &ranges[i]) == 0;
+    }
+    if (range_count > 0) {
+        fn(&ranges[0]);
+    }
+    for (int i = 1; i < range_count; i++) {
+        if (started != NULL && started[i]) {
+            pthread_join(workers[i], NULL);
+        } else {
+            fn(&ranges[i]);  // Could not start a thread, do its work here instead
+        }
+    }
+    free(workers);
+    free(started);
+}
+
+// Function to add the selected rows to the grouped aggregates, a word at a
+// time in row order. Each group's sub-population is added up per block and
+// the block sums are added in block order, as for a total over all rows.
+// Aggregates that ran out of memory are dropped from the list.
+static void run_groups(const Operation *ops, int *grouped, int *grouped_count, OpResult *results, const Table *table,
+                       const JoinedTables *joined, const Selection *selection, const int *population) {
+    int words = SELECTION_WORDS(selection->row_count);
+    for (int w = 0; w < words; w++) {
+        if (w % AGGREGATE_BLOCK_WORDS == 0) {
+            for (int a = 0; a < *grouped_count; a++) {
+                results[grouped[a]].groups.blocks++;
+            }
+        }
+        uint64_t bits = selection->bits[w];
+        if (bits == 0) continue;
+        for (int a = 0; a < *grouped_count; a++) {
+            OpResult *result = &results[grouped[a]];
+            if (!add_word_groups(&ops[grouped[a]], result, table, joined, population, bits, w * 64)) {
+                group_table_free(&result->groups);
+                grouped[a--] = grouped[--*grouped_count];
+            }
+        }
+    }
+}
+
+// Function to evaluate the operations in [first, last) in a single pass. The
+// filters are applied 64 rows at a time, each one only to the rows that
+// survived the ones before it, and the surviving rows are fed straight into
+// the aggregates. Up to threads threads share the blocks of the pass; grouped
+// aggregates then go over the surviving rows on this thread.
+static void run_segment(const Operation *ops, int first, int last, OpResult *results, const Table *table,
+                        const JoinedTables *joined, Selection *selection, const int *population, int threads) {
+    // Indices of the filters and of the aggregates in the segment
+    int *filters = malloc((last - first) * sizeof(int));
+    int *aggregates = malloc((last - first) * sizeof(int));
+    int *grouped = malloc((last - first) * sizeof(int));
+    int filter_count = 0, aggregate_count = 0, grouped_count = 0;
+    int block_count = (SELECTION_WORDS(selection->row_count) + AGGREGATE_BLOCK_WORDS - 1) / AGGREGATE_BLOCK_WORDS;
+    int range_count = threads < block_count ? threads : block_count;
+    SegmentRange *ranges = calloc(range_count > 0 ? range_count : 1, sizeof(SegmentRange));
+    int *counts = calloc((size_t)(range_count > 0 ? range_count : 1) * (last - first), sizeof(int));
+    int64_t *populations = calloc((size_t)(range_count > 0 ? range_count : 1) * (last - first), sizeof(int64_t));
+    double *block_subs = calloc((size_t)(block_count > 0 ? block_count : 1) * (last - first), sizeof(double));
+    if (filters == NULL || aggregates == NULL || grouped == NULL || ranges == NULL || counts == NULL
+        || populations == NULL || block_subs == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(filters);
+        free(aggregates);
+        free(grouped);
+        free(ranges);
+        free(counts);
+        free(populations);
+        free(block_subs);
+        return;
+    }
+
+    for (int i = first; i < last; i++) {
+        if (is_filter(&ops[i])) {
+            filters[filter_count++] = i;
+        } else if (ops[i].type != OP_MESSAGE && ops[i].group_column < 0) {
+            aggregates[aggregate_count++] = i;
+        } else if (ops[i].type != OP_MESSAGE && results[i].groups.groups != NULL) {
+            grouped[grouped_count++] = i;  // Otherwise memory ran out while grouping
+        }
+    }
+
+    // Selective filters are answered from an index as a bitmap of the rows
+    // they keep. The words of rows they rule out are skipped after one AND.
+    uint64_t **indexed = calloc(filter_count > 0 ? filter_count : 1, sizeof(uint64_t *));
+    for (int f = 0; indexed != NULL && f < filter_count; f++) {
+        indexed[f] = index_bitmap(&ops[filters[f]], table);
+    }
+
+    // Every range gets an even share of the blocks
+    for (int r = 0; r < range_count; r++) {
+        SegmentRange *range = &ranges[r];
+        range->ops = ops;
+        range->filters = filters;
+        range->filter_count = filter_count;
+        range->aggregates = aggregates;
+        range->aggregate_count = aggregate_count;
+        range->indexed = indexed;
+        range->table = table;
+        range->joined = joined;
+        range->selection = selection;
+        range->population = population;
+        range->first_block = (int)((int64_t)block_count * r / range_count);
+        range->last_block = (int)((int64_t)block_count * (r + 1) / range_count);
+        range->counts = counts + r * (last - first);
+        range->populations = populations + r * (last - first);
+        range->block_subs = block_subs;
+        range->block_count = block_count;
+    }
+    run_ranges(ranges, range_count, run_range);
+
+    // Combine the ranges, and the block sums in block order
+    for (int r = 0; r < range_count; r++) {
+        for (int f = 0; f < filter_count; f++) {
+            results[filters[f]].count += ranges[r].counts[f];
+        }
+        for (int a = 0; a < aggregate_count; a++) {
+            results[aggregates[a]].population += ranges[r].populations[a];
+        }
+    }
+    for (int a = 0; a < aggregate_count; a++) {
+        for (int block = 0; block < block_count; block++) {
+            compensated_add(&results[aggregates[a]].sub, block_subs[a * block_count + block]);
+        }
+    }
+
+    run_groups(ops, grouped, &grouped_count, results, table, joined, selection, population);
+
+    if (filter_count > 0) {
+        selection->count = results[filters[filter_count - 1]].count;
+    }
+    for (int f = 0; indexed != NULL && f < filter_count; f++) {
+        free(indexed[f]);
+    }
+    free(indexed);
+    free(filters);
+    free(aggregates);
+    free(grouped);
+    free(ranges);
+    free(counts);
+    free(populations);
+    free(block_subs);
+}
+
+// Function to start the group tables of the grouped aggregates in [first, last)
+static void init_groups(const Operation *ops, int first, int last, OpResult *results, const Table *table) {
+    for (int i = first; i < last; i++) {
+        if (!is_filter(&ops[i]) && ops[i].type != OP_MESSAGE && ops[i].group_column >= 0) {
+            group_table_init(&results[i].groups, table, ops[i].group_column);
+        }
+    }
+}
+
+// Function to find the end of the segment that starts at first: its filters
+// and the aggregates that follow them. A top, sort or join needs every row
+// before it to be settled, so it is a segment of its own.
+static int segment_end(const Operation *ops, int count, int first) {
+    int i = first;
+    if (i < count && stands_alone(&ops[i])) {
+        return i + 1;
+    }
+    while (i < count && ops[i].type != OP_POPULATION_TOTAL && ops[i].type != OP_POPULATION_FIELD
+           && ops[i].type != OP_PERCENT_FIELD && !stands_alone(&ops[i])) {
+        i++;
+    }
+    while (i < count && !is_filter(&ops[i]) && !stands_alone(&ops[i])) {
+        i++;
+    }
+    return i;
+}
+
+// Function to run a top: the selection becomes the first rows in the order
+// of its field. A sort only orders display, so the rows stay as they are.
+static void run_order(const Operation *op, OpResult *result, const Table *table, Selection *selection, int threads) {
+    uint32_t *rows;
+    int count = op->type == OP_TOP ? sort_rows(table, selection, op->column, op->descending, op->limit, threads, &rows) : -1;
+    if (count >= 0) {
+        memset(selection->bits, 0, SELECTION_WORDS(selection->row_count) * sizeof(uint64_t));
+        for (int i = 0; i < count; i++) {
+            selection->bits[rows[i] / 64] |= UINT64_C(1) << (rows[i] % 64);
+        }
+        selection->count = count;
+        free(rows);
+    }
+    result->count = selection->count;
+}
+
+// Function to run a join: load the columns of the file the plan reads, and
+// keep the selected rows that match one of its rows. If the join failed to
+// compile, the file cannot be loaded or memory runs out, no rows are kept.
+static void run_join(const Plan *plan, const Operation *op, OpResult *result, JoinedTables *joined, const Table *table,
+                     Selection *selection, int threads) {
+    Join *join = &plan->joins[op->join];
+    JoinedRows *rows = &joined->rows[joined->count++];
+    int column_count = join->config.valid_fields_count;
+    memset(rows, 0, sizeof(*rows));
+    rows->first_column = join->first_column;
+
+    unsigned char *load = calloc(column_count > 0 ? column_count : 1, 1);
+    for (int i = 0; load != NULL && i < plan->count; i++) {
+        const Operation *other = &plan->ops[i];
+        for (int t = -1; t < other->term_count; t++) {
+            int column = (t < 0 ? other->column : other->terms[t].column) - join->first_column;
+            if (column >= 0 && column < column_count) load[column] = 1;
+        }
+    }
+    for (int c = 0; load != NULL && c < column_count; c++) {
+        load[c] = load[c] || c < join->key_count || plan->display;
+    }
+
+    int other_keys[MAX_JOIN_KEYS];
+    for (int k = 0; k < join->key_count; k++) other_keys[k] = k;
+    int loaded = load != NULL && !join->failed ? process_demographics_file(&join->input, &rows->table, &join->config, load, threads) : -1;
+    if (loaded >= 0) {
+        rows->matches = malloc((table->row_count > 0 ? table->row_count : 1) * sizeof(uint32_t));
+    }
+    if (rows->matches == NULL
+        || join_rows(table, selection, join->key_columns, &rows->table, other_keys, join->key_count, rows->matches) < 0) {
+        if (load == NULL || (loaded >= 0 && rows->matches == NULL)) {
+            fprintf(stderr, "Memory allocation failed\n");
+        }
+        free(rows->matches);
+        rows->matches = NULL;
+        memset(selection->bits, 0, SELECTION_WORDS(selection->row_count) * sizeof(uint64_t));
+        selection->count = 0;
+    }
+    free(load);
+    result->count = selection->count;
+}
+
+// Function to note that an aggregate names a field that is not a percentage column
+static void print_unknown_field(const Operation *op, Output *out) {
+    char message[160];
+    snprintf(message, sizeof(message), "Unknown field: %s\n", op->field);
+    output_message(out, message, 0);
+}
+
+// Function to print a grouped aggregate, one line per group in key order
+static void print_groups(const Operation *op, const OpResult *result, const Config *config, Output *out) {
+    const GroupTable *groups = &result->groups;
+    if (groups->groups == NULL) {
+        return;  // Memory ran out while grouping
+    }
+    GroupTotals **sorted = group_table_sorted(groups);
+    if (sorted == NULL) {
+        return;
+    }
+
+    if (op->type != OP_POPULATION_TOTAL && op->column < 0) {
+        print_unknown_field(op, out);
+    }
+    const char *name = config->valid_fields[op->group_column];
+    for (uint32_t i = 0; i < groups->count; i++) {
+        const GroupTotals *group = sorted[i];
+        char key[256];
+        group_format_key(groups, group, key, sizeof(key));
+        switch (op->type) {
+            case OP_POPULATION_TOTAL:
+                output_population_total(out, name, key, group->population);
+                break;
+            case OP_POPULATION_FIELD:
+                output_population(out, op->field, name, key, compensated_value(&group->sub));
+                break;
+            default:
+                output_percent(out, op->field, name, key, group->population,
+                               group->population > 0 ? (compensated_value(&group->sub) / group->population) * 100 : 0);
+                break;
+        }
+    }
+    free(sorted);
+}
+
+// Function to write a filter's comparisons as written, joined by " && " and
+// " || ". Readable text rounds operands to two decimals; exact text is the
+// filter as it would be written, with operands that read back exactly.
+static void filter_text(const Operation *op, int exact, char *text, size_t size) {
+    size_t length = 0;
+    text[0] = '\0';
+    for (int t = 0; t < op->term_count && length < size; t++) {
+        const Predicate *term = &op->terms[t];
+        const char *join = t == 0 ? "" : term->group != op->terms[t - 1].group ? " || " : " && ";
+        int between = strcmp(term->comparison, "between") == 0;
+        if (exact) {
+            char number[32], high[32] = "";
+            double_text(number, sizeof(number), term->number);
+            if (between) double_text(high, sizeof(high), term->high);
+            snprintf(text + length, size - length, "%s%s:%s:%s%s%s", join, term->field, term->comparison, number,
+                     between ? ":" : "", high);
+        } else if (between) {
+            snprintf(text + length, size - length, "%s%s between %.2f and %.2f", join, term->field, term->number, term->high);
+        } else {
+            snprintf(text + length, size - length, "%s%s %s %.2f", join, term->field, term->comparison, term->number);
+        }
+        length += strlen(text + length);
+    }
+}
+
+// Function to print the results of the operations in [first, last) in file order
+static void print_segment(const Operation *ops, int first, int last, const OpResult *results, const Join *joins,
+                          const Config *config, Output *out) {
+    for (int i = first; i < last; i++) {
+        const Operation *op = &ops[i];
+        const OpResult *result = &results[i];
+        if (op->group_column >= 0) {
+            print_groups(op, result, config, out);
+            continue;
+        }
+        switch (op->type) {
+            case OP_FILTER_STATE:
+                output_filter_state(out, op->field, result->count);
+                break;
+            case OP_FILTER_FIELD:
+                if (op->term_count == 1 && strcmp(op->terms[0].comparison, "between") != 0) {
+                    const Predicate *term = &op->terms[0];
+                    output_filter(out, term->field, term->comparison, term->number, result->count);
+                } else {
+                    char text[2048], exact[2048];
+                    filter_text(op, 0, text, sizeof(text));
+                    filter_text(op, 1, exact, sizeof(exact));
+                    output_filter_expression(out, text, exact, result->count);
+                }
+                break;
+            case OP_POPULATION_TOTAL:
+                output_population_total(out, NULL, NULL, result->population);
+                break;
+            case OP_POPULATION_FIELD:
+                if (op->column < 0) {
+                    print_unknown_field(op, out);
+                }
+                output_population(out, op->field, NULL, NULL, compensated_value(&result->sub));
+                break;
+            case OP_PERCENT_FIELD:
+                if (op->column < 0) {
+                    print_unknown_field(op, out);
+                }
+                output_percent(out, op->field, NULL, NULL, result->population,
+                               result->population > 0 ? (compensated_value(&result->sub) / result->population) * 100 : 0);
+                break;
+            case OP_TOP:
+                output_top(out, op->field, op->limit, op->descending, result->count);
+                break;
+            case OP_SORT:
+                output_sort(out, op->field, op->descending, result->count);
+                break;
+            case OP_JOIN:
+                output_join(out, joins[op->join].file, op->field, result->count);
+                break;
+            case OP_MESSAGE:
+                output_message(out, op->field, op->error);
+                break;
+        }
+    }
+}
+
+// Function to record the operations in [first, last), evaluated in the given
+// pass, with the rows each one received and kept
+static void record_segment(Stats *stats, const Operation *ops, int first, int last, const OpResult *results,
+                           const Join *joins, const Config *config, int rows_in, int pass) {
+    for (int i = first; i < last; i++) {
+        const Operation *op = &ops[i];
+        StatsOperation record;
+        record.line = op->line;
+        record.pass = pass;
+        record.rows_in = rows_in;
+        record.groups = op->group_column >= 0 ? (int)results[i].groups.count : -1;
+        switch (op->type) {
+            case OP_FILTER_STATE:
+                snprintf(record.text, sizeof(record.text), "filter-state:%s", op->field);
+                break;
+            case OP_FILTER_FIELD: {
+                char exact[2048];
+                filter_text(op, 1, exact, sizeof(exact));
+                snprintf(record.text, sizeof(record.text), "filter:%.240s", exact);
+                break;
+            }
+            case OP_POPULATION_TOTAL:
+                snprintf(record.text, sizeof(record.text), "population-total");
+                break;
+            case OP_POPULATION_FIELD:
+                snprintf(record.text, sizeof(record.text), "population:%s", op->field);
+                break;
+            case OP_PERCENT_FIELD:
+                snprintf(record.text, sizeof(record.text), "percent:%s", op->field);
+                break;
+            case OP_TOP:
+                snprintf(record.text, sizeof(record.text), "top:%s:%d:%s", op->field, op->limit, op->descending ? "desc" : "asc");
+                break;
+            case OP_SORT:
+                snprintf(record.text, sizeof(record.text), "sort:%s:%s", op->field, op->descending ? "desc" : "asc");
+                break;
+            case OP_JOIN:
+                snprintf(record.text, sizeof(record.text), "join:%.120s:%.120s", joins[op->join].file, op->field);
+                break;
+            case OP_MESSAGE:
+                snprintf(record.text, sizeof(record.text), "%.*s", (int)strcspn(op->field, "\n"), op->field);
+                break;
+        }
+        if (op->group_column >= 0) {
+            size_t length = strlen(record.text);
+            snprintf(record.text + length, sizeof(record.text) - length, " (group-by:%s)", config->valid_fields[op->group_column]);
+        }
+        if (is_filter(op) || op->type == OP_TOP || op->type == OP_JOIN) {
+            rows_in = results[i].count;
+        }
+        record.rows_out = rows_in;
+        if (!stats_operation(stats, &record)) {
+            return;
+        }
+    }
+}
+
+// The filters a plan has applied so far, as the key of the selection they
+// leave in the table's filter cache
+typedef struct {
+    char *key;       // The normalized filters, one per line
+    size_t length;
+    size_t capacity;
+    int *filters;    // Index of each filter among the operations
+    int count;
+    int *counts;     // Rows kept after each filter
+} FilterChain;
+
+static int compare_text(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Function to write one comparison of a filter as a key: the field, the
+// comparison as a symbol and the operand as a canonical number
+static void term_key(const Predicate *term, char *text, size_t size) {
+    const char *c = term->comparison;
+    const char *symbol = strcmp(c, "ge") == 0 ? ">=" : strcmp(c, "le") == 0 ? "<=" : strcmp(c, "gt") == 0 ? ">"
+                       : strcmp(c, "lt") == 0 ? "<" : strcmp(c, "eq") == 0 ? "==" : NULL;
+    if (strcmp(c, "between") == 0) {
+        snprintf(text, size, "%.17g<=%s<=%.17g", term->number, term->field, term->high);
+    } else if (symbol != NULL) {
+        snprintf(text, size, "%s%s%.17g", term->field, symbol, term->number);
+    } else {
+        snprintf(text, size, "%s:%s", term->field, c);
+    }
+}
+
+// Function to append a filter to the key of a chain, as text that is the
+// same for any two filters that keep the same rows however they were
+// written: "State==AL" or "State in AL,CA" with the states sorted, and the
+// comparisons sorted within each "&&" group and the groups sorted
+static int append_filter(FilterChain *chain, const Operation *op) {
+    char text[MAX_TERMS * 164];
+    if (op->type == OP_FILTER_STATE) {
+        const char *states[MAX_STATES];
+        for (int i = 0; i < op->state_count; i++) states[i] = op->states[i];
+        qsort(states, op->state_count, sizeof(states[0]), compare_text);
+        size_t length = (size_t)snprintf(text, sizeof(text), op->state_count == 1 ? "State==" : "State in ");
+        for (int i = 0; i < op->state_count; i++) {
+            if (i > 0 && strcmp(states[i], states[i - 1]) == 0) continue;
+            length += snprintf(text + length, sizeof(text) - length, "%s%s", i > 0 ? "," : "", states[i]);
+        }
+        snprintf(text + length, sizeof(text) - length, "\n");
+    } else {
+        char terms[MAX_TERMS][160], groups[MAX_TERMS][MAX_TERMS * 164];
+        const char *sorted[MAX_TERMS];
+        int group_count = 0, t = 0;
+        while (t < op->term_count) {
+            // The comparisons of the group starting at t, sorted
+            int count = 0, group = op->terms[t].group;
+            for (; t < op->term_count && op->terms[t].group == group; t++) {
+                term_key(&op->terms[t], terms[t], sizeof(terms[t]));
+                sorted[count++] = terms[t];
+            }
+            qsort(sorted, count, sizeof(sorted[0]), compare_text);
+            size_t length = 0;
+            for (int i = 0; i < count; i++) {
+                length += snprintf(groups[group_count] + length, sizeof(groups[0]) - length, "%s%s", i > 0 ? "&&" : "", sorted[i]);
+            }
+            group_count++;
+        }
+        for (int g = 0; g < group_count; g++) sorted[g] = groups[g];
+        qsort(sorted, group_count, sizeof(sorted[0]), compare_text);
+        size_t length = 0;
+        for (int g = 0; g < group_count; g++) {
+            length += snprintf(text + length, sizeof(text) - length, "%s%s", g > 0 ? "||" : "", sorted[g]);
+        }
+        snprintf(text + length, sizeof(text) - length, "\n");
+    }
+    size_t length = strlen(text);
+    if (chain->length + length + 1 > chain->capacity) {
+        size_t capacity = (chain->length + length + 1) * 2;
+        char *key = realloc(chain->key, capacity);
+        if (key == NULL) {
+            return 0;
+        }
+        chain->key = key;
+        chain->capacity = capacity;
+    }
+    memcpy(chain->key + chain->length, text, length + 1);
+    chain->length += length;
+    return 1;
+}
+
+// Function to resume the segment [first, last) from the filter cache. The
+// longest chain of the filters so far and the segment's own filters whose
+// selection is cached is restored, along with the rows each filter kept.
+// Adds the segment's filters to the chain. Returns the operation to
+// evaluate the rest of the segment from, or -1 if memory ran out.
+static int resume_segment(FilterChain *chain, const Operation *ops, int first, int last, OpResult *results,
+                          const Table *table, Selection *selection) {
+    int known = chain->count;
+    size_t *ends = malloc((last - first) * sizeof(size_t));
+    int *filters = realloc(chain->filters, (chain->count + last - first) * sizeof(int));
+    int *counts = realloc(chain->counts, (chain->count + last - first) * sizeof(int));
+    if (filters != NULL) chain->filters = filters;
+    if (counts != NULL) chain->counts = counts;
+    if (ends == NULL || filters == NULL || counts == NULL) {
+        free(ends);
+        return -1;
+    }
+    for (int i = first; i < last; i++) {
+        if (is_filter(&ops[i])) {
+            if (!append_filter(chain, &ops[i])) {
+                free(ends);
+                return -1;
+            }
+            ends[chain->count - known] = chain->length;
+            chain->filters[chain->count++] = i;
+        }
+    }
+
+    // Look for the longest cached chain, cutting the key short to try each
+    int from = first;
+    for (int n = chain->count; n > known; n--) {
+        char cut = chain->key[ends[n - 1 - known]];
+        chain->key[ends[n - 1 - known]] = '\0';
+        int found = filter_cache_get(table, chain->key, selection, chain->counts, n);
+        chain->key[ends[n - 1 - known]] = cut;
+        if (found) {
+            for (int f = 0; f < n; f++) {
+                results[chain->filters[f]].count = chain->counts[f];
+            }
+            from = chain->filters[n - 1] + 1;
+            break;
+        }
+    }
+    free(ends);
+    return from;
+}
+
+void plan_execute(const Plan *plan, const Table *table, Selection *selection, const Config *config, int threads, Output *out, Stats *stats) {
+    OpResult *results = calloc(plan->count > 0 ? plan->count : 1, sizeof(OpResult));
+    if (results == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    const int *population = table->columns[find_field(config, POPULATION_FIELD)].ints;
+    FilterChain chain;
+    memset(&chain, 0, sizeof(chain));
+    int caching = table->cache != NULL;
+    JoinedTables joined;
+    joined.count = 0;
+
+    // Split the plan into segments of filters followed by aggregates; each
+    // segment takes one pass over the data. The filters whose selection is
+    // in the filter cache are skipped, and the selection the segment's
+    // filters leave is added to it.
+    int i = 0;
+    while (i < plan->count) {
+        int first = i;
+        i = segment_end(plan->ops, plan->count, first);
+        int rows_in = selection->count;
+        StatsTime start = stats_now(stats);
+        init_groups(plan->ops, first, i, results, table);
+        if (plan->ops[first].type == OP_JOIN) {
+            run_join(plan, &plan->ops[first], &results[first], &joined, table, selection, threads);
+            // The rows a join keeps are not part of the filter cache's keys
+            caching = 0;
+        } else if (is_order(&plan->ops[first])) {
+            run_order(&plan->ops[first], &results[first], table, selection, threads);
+            // The rows a top keeps are not part of the filter cache's keys
+            caching = caching && plan->ops[first].type != OP_TOP;
+        } else {
+            int known = chain.count;
+            int from = caching ? resume_segment(&chain, plan->ops, first, i, results, table, selection) : first;
+            if (from < 0) {
+                caching = 0;  // The chain is incomplete from here on
+                from = first;
+            }
+            run_segment(plan->ops, from, i, results, table, &joined, selection, population, threads);
+            if (caching && chain.count > known && from <= chain.filters[chain.count - 1]) {
+                for (int f = 0; f < chain.count; f++) {
+                    chain.counts[f] = results[chain.filters[f]].count;
+                }
+                filter_cache_put(table, chain.key, selection, chain.counts, chain.count);
+            }
+        }
+        for (int j = first; j < i; j++) {
+            finish_groups(&results[j].groups);
+        }
+        stats_phase(stats, "execute", start);
+        int pass = stats_pass(stats, start);
+
+        start = stats_now(stats);
+        print_segment(plan->ops, first, i, results, plan->joins, config, out);
+        stats_phase(stats, "print", start);
+        if (stats != NULL) {
+            record_segment(stats, plan->ops, first, i, results, plan->joins, config, rows_in, pass);
+        }
+        for (int j = first; j < i; j++) {
+            group_table_free(&results[j].groups);
+        }
+    }
+
+    // If "display" is found, call the display function, with the rows in
+    // the order of the last top or sort and the fields of the joined files
+    if (plan->display) {
+        StatsTime start = stats_now(stats);
+        uint32_t *rows = NULL;
+        int count = 0;
+        if (plan->order >= 0) {
+            const Operation *op = &plan->ops[plan->order];
+            count = sort_rows(table, selection, op->column, op->descending, -1, threads, &rows);
+        }
+        DisplayJoin joins[MAX_JOINS];
+        for (int j = 0; j < joined.count; j++) {
+            joins[j].table = &joined.rows[j].table;
+            joins[j].config = &plan->joins[j].config;
+            joins[j].matches = joined.rows[j].matches;
+            joins[j].first_field = plan->joins[j].failed ? 0 : plan->joins[j].key_count;  // A failed join has no fields
+        }
+        if (count >= 0) {
+            output_display(out, table, selection, rows, count, config, config->required_count, joins, joined.count);
+        }
+        free(rows);
+        stats_phase(stats, "display", start);
+    }
+    for (int j = 0; j < joined.count; j++) {
+        table_free(&joined.rows[j].table);
+        free(joined.rows[j].matches);
+    }
+    free(chain.key);
+    free(chain.filters);
+    free(chain.counts);
+    free(results);
+}
+
+struct PlanRun {
+    Operation *ops;     // The plan's operations, with states bound as they appear
+    int count;
+    OpResult *results;
+    const Table *table;
+    const int *population;
+    int rows;           // Rows run so far
+    StatsTime start;
+};
+
+PlanRun *plan_run_begin(const Plan *plan, const Table *table, const Config *config, Stats *stats) {
+    PlanRun *run = calloc(1, sizeof(PlanRun));
+    if (run == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    run->count = plan->count;
+    run->ops = malloc((plan->count > 0 ? plan->count : 1) * sizeof(Operation));
+    run->results = calloc(plan->count > 0 ? plan->count : 1, sizeof(OpResult));
+    if (run->ops == NULL || run->results == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(run->ops);
+        free(run->results);
+        free(run);
+        return NULL;
+    }
+    memcpy(run->ops, plan->ops, plan->count * sizeof(Operation));
+    run->table = table;
+    run->population = table->columns[find_field(config, POPULATION_FIELD)].ints;
+    run->start = stats_now(stats);
+    init_groups(run->ops, 0, run->count, run->results, table);
+    return run;
+}
+
+int plan_run_block(PlanRun *run) {
+    const Table *table = run->table;
+    Selection selection;
+    if (!selection_init_all(&selection, table->row_count)) {
+        return 0;
+    }
+
+    // A state that was not in the table yet may have turned up in this block
+    for (int i = 0; i < run->count; i++) {
+        Operation *op = &run->ops[i];
+        for (int s = 0; op->type == OP_FILTER_STATE && s < op->state_count; s++) {
+            if (op->state_ids[s] == STRING_POOL_NONE) {
+                op->state_ids[s] = string_pool_find(&table->strings, op->states[s], strlen(op->states[s]));
+            }
+        }
+    }
+
+    // Every segment takes its turn over the block; the selection carries the
+    // rows each one keeps on to the next, as over a whole table
+    int i = 0;
+    while (i < run->count) {
+        int first = i;
+        i = segment_end(run->ops, run->count, first);
+        run_segment(run->ops, first, i, run->results, table, NULL, &selection, run->population, 1);
+    }
+    run->rows += table->row_count;
+    selection_free(&selection);
+    return 1;
+}
+
+void plan_run_end(PlanRun *run, const Config *config, Output *out, Stats *stats) {
+    int pass = stats_pass(stats, run->start);
+    StatsTime start = stats_now(stats);
+    for (int j = 0; j < run->count; j++) {
+        finish_groups(&run->results[j].groups);
+    }
+    print_segment(run->ops, 0, run->count, run->results, NULL, config, out);
+    stats_phase(stats, "print", start);
+
+    // The rows a segment received are the ones the last filter before it kept
+    int rows_in = run->rows;
+    int i = 0;
+    while (i < run->count) {
+        int first = i;
+        i = segment_end(run->ops, run->count, first);
+        if (stats != NULL) {
+            record_segment(stats, run->ops, first, i, run->results, NULL, config, rows_in, pass);
+        }
+        for (int j = first; j < i; j++) {
+            if (is_filter(&run->ops[j])) rows_in = run->results[j].count;
+        }
+    }
+}
+
+void plan_run_free(PlanRun *run) {
+    for (int j = 0; j < run->count; j++) {
+        group_table_free(&run->results[j].groups);
+    }
+    free(run->results);
+    free(run->ops);
+    free(run);
+}
+
+// Function to process the operations file
+void process_operations(const char *operations_file, const Table *table, Selection *selection, const Config *config, int threads, Output *out, Stats *stats) {
+    FILE *file = fopen(operations_file, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file: %s\n", operations_file);
+        return;
+    }
+
+    Plan plan;
+    StatsTime start = stats_now(stats);
+    int compiled = plan_compile(&plan, file, table, config);
+    stats_phase(stats, "compile", start);
+    if (compiled) {
+        plan_execute(&plan, table, selection, config, threads, out, stats);
+        plan_free(&plan);
+    }
+
+    fclose(file);
+}
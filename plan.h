@@ -0,0 +1,153 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdio.h>
+
+#include "table.h"
+#include "kernels.h"
+#include "stats.h"
+#include "output.h"
+#include "loader.h"
+#include "join.h"
+
+// Kinds of operations an operations file can contain
+typedef enum {
+    OP_FILTER_STATE,
+    OP_FILTER_FIELD,
+    OP_POPULATION_TOTAL,
+    OP_POPULATION_FIELD,
+    OP_PERCENT_FIELD,
+    OP_TOP,            // Keeps the first rows in the order of a field
+    OP_SORT,           // Orders the rows display prints
+    OP_JOIN,           // Keeps the rows that match a row of another file
+    OP_MESSAGE         // A diagnostic for a line that could not be compiled
+} OpType;
+
+#define MAX_TERMS 8    // Comparisons one filter line can combine
+#define MAX_STATES 64  // States one filter-state line can list
+#define MAX_JOINS 4    // Files one operations file can join
+
+// One comparison of a filter line. eq and between test value >= low and
+// value <= high; the other comparisons are a single test.
+typedef struct {
+    int column;
+    char field[100];          // Field name as written
+    char comparison[8];       // ge, le, gt, lt, eq or between, as written
+    double number;            // Value compared against, or the low end of between
+    double high;              // between: the high end
+    MaskKernel kernels[2];    // Kernels the value must pass; the second may be NULL
+    KernelArg args[2];        // Thresholds for the kernels
+    int group;                // Terms of a group are and'ed, groups are or'ed
+} Predicate;
+
+// One compiled line of an operations file. Fields and states are resolved to
+// column indices and string ids when the plan is compiled.
+typedef struct {
+    OpType type;
+    int column;               // Column the operation reads, or -1 if the field is unknown
+    Predicate terms[MAX_TERMS];  // OP_FILTER_FIELD: the comparisons, as written
+    int term_count;
+    unsigned char order[MAX_TERMS];  // OP_FILTER_FIELD: terms in the order they are evaluated
+    char states[MAX_STATES][3];      // OP_FILTER_STATE: the state codes listed
+    uint32_t state_ids[MAX_STATES];  // OP_FILTER_STATE: the interned state codes
+    int state_count;
+    char field[128];          // Field name, state codes or message text as written
+    int limit;                // OP_TOP: rows to keep
+    int descending;           // OP_TOP and OP_SORT: largest values first
+    int join;                 // OP_JOIN: the join in the plan's joins
+    int error;                // OP_MESSAGE: 1 if the message goes to the error stream
+    int group_column;         // Aggregates: column to report per value of, or -1
+    int line;                 // Line of the operations file it was compiled from
+} Operation;
+
+// A file joined to the table by "join:file:keys". Its key fields are its
+// required fields, with the types of the table's; the rest of its header is
+// read as floats. In the plan, column c of the file is column
+// first_column + c, after the columns of the table and of earlier joins.
+typedef struct {
+    char file[256];
+    char keys[MAX_JOIN_KEYS][100];   // Key fields as written
+    const char *key_names[MAX_JOIN_KEYS];
+    const char *key_formats[MAX_JOIN_KEYS];
+    FieldType key_types[MAX_JOIN_KEYS];
+    int key_columns[MAX_JOIN_KEYS];  // Columns of the keys in the table
+    int key_count;
+    Config config;                   // Fields of the file
+    DemographicsFile input;          // The file with its header read, if it is open
+    int open;
+    int failed;                      // A key field or the file was not found: the join keeps no rows
+    int first_column;
+} Join;
+
+// An operations file compiled against a table
+typedef struct {
+    Operation *ops;
+    int count;
+    int capacity;
+    Join *joins;       // MAX_JOINS of them, allocated with the first one
+    int join_count;
+    int display;       // Display the selected rows after all operations
+    int order;         // The last top or sort operation, which orders display, or -1
+    int group_column;  // Column the next aggregates are grouped by, or -1
+} Plan;
+
+// Compile the operations read from file. Returns 0 if memory ran out. The
+// table may be NULL to compile a plan only to see which columns of the
+// table it reads; the files it joins are then not opened, and fields the
+// table does not have are taken for fields of a joined file.
+// filter:, population: and percent: can name the fields of joined files
+// once they are joined; the table's own fields come first.
+// With a table, the comparisons of a filter line are put in the order that
+// is expected to rule out rows soonest for the least work, estimated from
+// the statistics of their columns; the order never changes the rows kept.
+int plan_compile(Plan *plan, FILE *file, const Table *table, const Config *config);
+
+// Set columns[i] for every column of the table the plan reads
+void plan_columns(const Plan *plan, const Config *config, unsigned char *columns);
+
+// Set columns[i] for every column the operations file reads. Returns 0 if
+// memory ran out.
+int needed_columns(const char *operations_file, const Config *config, unsigned char *columns);
+
+// Run a compiled plan, writing results and diagnostics to out.
+// A join loads the columns of its file that the plan reads and keeps the
+// selected rows that match a row of it on the key fields (the first such
+// row, if there are several); later operations read the file's values of
+// that row. Display prints the fields of the joined files after the
+// table's own.
+// A top or sort operation orders the selected rows by its field when it is
+// reached; top then keeps only the first rows. Display prints the rows in
+// the order of the last one.
+// Consecutive filters and the aggregates that follow them are evaluated
+// together in one pass over the selected rows, shared by up to threads
+// threads. Populations are summed as 64-bit integers and sub-populations
+// per block of rows, with the block sums added up with compensation in
+// block order, so the results are the same whatever the number of threads.
+// If stats is not NULL the time of each pass and the rows each operation
+// kept are added to it.
+void plan_execute(const Plan *plan, const Table *table, Selection *selection, const Config *config, int threads, Output *out, Stats *stats);
+
+void plan_free(Plan *plan);
+
+// A plan run over a table whose rows arrive in blocks (see stream.h). Each
+// block goes through all the segments in turn, and the results add up over
+// the blocks to exactly what plan_execute gives for the rows all at once.
+// The table is the one the blocks are read into; display, top, sort and
+// join, which need all the rows at once, are not supported.
+typedef struct PlanRun PlanRun;
+
+// Returns NULL if memory ran out
+PlanRun *plan_run_begin(const Plan *plan, const Table *table, const Config *config, Stats *stats);
+
+// Run the rows the table holds now. Returns 0 if memory ran out.
+int plan_run_block(PlanRun *run);
+
+// Write the results, and record them in stats if it is not NULL (the whole
+// run counts as one pass)
+void plan_run_end(PlanRun *run, const Config *config, Output *out, Stats *stats);
+void plan_run_free(PlanRun *run);
+
+// Function to process the operations file
+void process_operations(const char *operations_file, const Table *table, Selection *selection, const Config *config, int threads, Output *out, Stats *stats);
+
+#endif
@@ -0,0 +1,401 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "plan.h"
+
+// Connections accepted but not yet picked up by a worker
+typedef struct {
+    const Table *table;
+    const Config *config;
+    OutputFormat format;
+    int *pending;        // Ring buffer of client sockets
+    int pending_capacity;
+    int pending_start;
+    int pending_count;
+    int *active;         // Socket each worker is serving, or -1
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;     // A connection was queued or the server is stopping
+    pthread_cond_t space;     // A connection was taken off the queue
+} ClientQueue;
+
+// Arguments passed to each worker thread
+typedef struct {
+    ClientQueue *queue;
+    int index;
+} Worker;
+
+// How long the accepting thread waits for room in a full queue before it
+// looks at interrupted again
+#define QUEUE_WAIT_MS 100
+
+static volatile sig_atomic_t interrupted = 0;
+
+// Written to by the signal handler, so that a poll() on the listener wakes
+// up even if the signal arrives just before it
+static int wake_pipe[2] = { -1, -1 };
+
+static void handle_interrupt(int signal_number) {
+    (void)signal_number;
+    int saved = errno;
+    interrupted = 1;
+    if (wake_pipe[1] != -1) {
+        ssize_t written = write(wake_pipe[1], "", 1);
+        (void)written;
+    }
+    errno = saved;
+}
+
+// Function to read one script into *buffer. Returns 1 if a script was read
+// (possibly empty) and 0 if the input ended before anything was read.
+static int read_script(FILE *in, char **buffer, size_t *capacity, size_t *length) {
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_length;
+    int read_any = 0;
+
+    *length = 0;
+    while ((line_length = getline(&line, &line_capacity, in)) != -1) {
+        read_any = 1;
+        size_t end = line_length;
+        while (end > 0 && (line[end - 1] == '\n' || line[end - 1] == '\r')) {
+            end--;
+        }
+        if (end == 1 && line[0] == '.') {
+            break;
+        }
+        if (*length + line_length + 1 > *capacity) {
+            size_t new_capacity = *capacity ? *capacity : 1024;
+            while (new_capacity < *length + line_length + 1) {
+                new_capacity *= 2;
+            }
+            char *grown = realloc(*buffer, new_capacity);
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                free(line);
+                return 0;
+            }
+            *buffer = grown;
+            *capacity = new_capacity;
+        }
+        memcpy(*buffer + *length, line, line_length);
+        *length += line_length;
+        (*buffer)[*length] = '\0';
+    }
+    free(line);
+    return read_any;
+}
+
+// Function to compile and run one script against a fresh selection
+static void run_script(char *script, size_t length, const Table *table, const Config *config, Output *out) {
+    if (length > 0) {
+        FILE *file = fmemopen(script, length, "r");
+        Plan plan;
+        Selection selection;
+        if (file == NULL) {
+            output_message(out, "Could not read script\n", 1);
+        } else {
+            if (plan_compile(&plan, file, table, config)) {
+                if (selection_init_all(&selection, table->row_count)) {
+                    // Clients are already served in parallel; each script runs on one thread
+                    plan_execute(&plan, table, &selection, config, 1, out, NULL);
+                    selection_free(&selection);
+                }
+                plan_free(&plan);
+            }
+            fclose(file);
+        }
+    }
+    writer_string(&out->writer, ".\n");
+    writer_flush(&out->writer);
+    fflush(out->writer.file);
+    if (out->err != out->writer.file) {
+        fflush(out->err);
+    }
+}
+
+// Function to answer every script on a stream until it ends
+static void serve_stream(FILE *in, FILE *out, FILE *err, const Table *table, const Config *config, OutputFormat format) {
+    char *script = NULL;
+    size_t capacity = 0;
+    size_t length;
+    Output output;
+
+    if (!output_init(&output, out, err, format)) {
+        return;
+    }
+    while (read_script(in, &script, &capacity, &length)) {
+        run_script(script, length, table, config, &output);
+        if (ferror(out)) {
+            break;  // The client went away
+        }
+    }
+    output_free(&output);
+    free(script);
+}
+
+// Function to serve one connected client; closes the socket
+static void serve_client(int client, const Table *table, const Config *config, OutputFormat format) {
+    int output = dup(client);
+    FILE *in = fdopen(client, "r");
+    FILE *out = output == -1 ? NULL : fdopen(output, "w");
+
+    if (in != NULL && out != NULL) {
+        serve_stream(in, out, out, table, config, format);
+    }
+    if (in != NULL) fclose(in); else close(client);
+    if (out != NULL) fclose(out); else if (output != -1) close(output);
+}
+
+// Worker thread: serve queued clients until the server stops
+static void *worker_main(void *argument) {
+    Worker *worker = argument;
+    ClientQueue *queue = worker->queue;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->pending_count == 0 && !queue->stopping) {
+            pthread_cond_wait(&queue->ready, &queue->lock);
+        }
+        if (queue->stopping) {
+            pthread_mutex_unlock(&queue->lock);
+            return NULL;
+        }
+        int client = queue->pending[queue->pending_start];
+        queue->pending_start = (queue->pending_start + 1) % queue->pending_capacity;
+        queue->pending_count--;
+        // Stopping the server shuts down a duplicate of the socket, which
+        // stays open until the slot is cleared so it cannot be reused first
+        queue->active[worker->index] = dup(client);
+        pthread_cond_signal(&queue->space);
+        pthread_mutex_unlock(&queue->lock);
+
+        serve_client(client, queue->table, queue->config, queue->format);
+
+        pthread_mutex_lock(&queue->lock);
+        int guard = queue->active[worker->index];
+        queue->active[worker->index] = -1;
+        pthread_mutex_unlock(&queue->lock);
+        if (guard != -1) {
+            close(guard);
+        }
+    }
+}
+
+// Function to create the listening socket at path
+static int open_socket(const char *path) {
+    struct sockaddr_un address;
+    struct stat info;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    // Replace a socket left behind by an earlier server, but nothing else
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+        perror("socket");
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        fprintf(stderr, "Could not bind %s: %s\n", path, strerror(errno));
+        close(listener);
+        return -1;
+    }
+    if (listen(listener, SOMAXCONN) == -1) {
+        perror("listen");
+        close(listener);
+        unlink(path);
+        return -1;
+    }
+    return listener;
+}
+
+// Function to accept clients on a socket and hand them to a pool of workers
+static int serve_socket(const char *path, const Table *table, const Config *config, OutputFormat format, int threads) {
+    ClientQueue queue;
+    Worker *workers = malloc(threads * sizeof(Worker));
+    pthread_t *ids = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    int i;
+
+    memset(&queue, 0, sizeof(queue));
+    queue.table = table;
+    queue.config = config;
+    queue.format = format;
+    queue.pending_capacity = threads;
+    queue.pending = malloc(threads * sizeof(int));
+    queue.active = malloc(threads * sizeof(int));
+    if (workers == NULL || ids == NULL || queue.pending == NULL || queue.active == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(workers);
+        free(ids);
+        free(queue.pending);
+        free(queue.active);
+        return -1;
+    }
+
+    int listener = open_socket(path);
+    if (listener == -1) {
+        free(workers);
+        free(ids);
+        free(queue.pending);
+        free(queue.active);
+        return -1;
+    }
+
+    if (pipe(wake_pipe) == -1) {
+        perror("pipe");
+        close(listener);
+        unlink(path);
+        free(workers);
+        free(ids);
+        free(queue.pending);
+        free(queue.active);
+        return -1;
+    }
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    // Stop on SIGINT or SIGTERM. The workers (and the threads they start)
+    // block both, so the signal always reaches this thread.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_interrupt;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t stop_signals, previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.ready, NULL);
+    pthread_cond_init(&queue.space, NULL);
+    for (i = 0; i < threads; i++) {
+        queue.active[i] = -1;  // Before any worker starts, so no slot is ever read unset
+    }
+    for (i = 0; i < threads; i++) {
+        workers[i].queue = &queue;
+        workers[i].index = i;
+        if (pthread_create(&ids[i], NULL, worker_main, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (started == 0) {
+        fprintf(stderr, "Could not start worker threads\n");
+    } else {
+        fprintf(stderr, "Serving on %s with %d threads\n", path, started);
+        while (!interrupted) {
+            // Take no client while the queue is full, checking for a signal
+            // every QUEUE_WAIT_MS
+            pthread_mutex_lock(&queue.lock);
+            while (queue.pending_count == queue.pending_capacity && !interrupted) {
+                struct timespec until;
+                clock_gettime(CLOCK_REALTIME, &until);
+                until.tv_nsec += QUEUE_WAIT_MS * 1000000L;
+                until.tv_sec += until.tv_nsec / 1000000000L;
+                until.tv_nsec %= 1000000000L;
+                pthread_cond_timedwait(&queue.space, &queue.lock, &until);
+            }
+            pthread_mutex_unlock(&queue.lock);
+            if (interrupted) {
+                break;
+            }
+
+            // Wait for a client or for the signal handler's byte
+            struct pollfd fds[2] = { { listener, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+            if (poll(fds, 2, -1) == -1) {
+                if (errno != EINTR) {
+                    perror("poll");
+                    break;
+                }
+                continue;
+            }
+            if (fds[1].revents != 0) {
+                break;
+            }
+            int client = accept(listener, NULL, NULL);
+            if (client == -1) {
+                if (errno != EINTR && errno != ECONNABORTED) {
+                    perror("accept");
+                    break;
+                }
+                continue;
+            }
+            pthread_mutex_lock(&queue.lock);
+            queue.pending[(queue.pending_start + queue.pending_count) % queue.pending_capacity] = client;
+            queue.pending_count++;
+            pthread_cond_signal(&queue.ready);
+            pthread_mutex_unlock(&queue.lock);
+        }
+    }
+
+    // Wake the workers, cut off the clients they are serving and wait for them
+    pthread_mutex_lock(&queue.lock);
+    queue.stopping = 1;
+    for (i = 0; i < started; i++) {
+        if (queue.active[i] != -1) {
+            shutdown(queue.active[i], SHUT_RDWR);
+        }
+    }
+    while (queue.pending_count > 0) {
+        close(queue.pending[queue.pending_start]);
+        queue.pending_start = (queue.pending_start + 1) % queue.pending_capacity;
+        queue.pending_count--;
+    }
+    pthread_cond_broadcast(&queue.ready);
+    pthread_mutex_unlock(&queue.lock);
+    for (i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+
+    close(listener);
+    unlink(path);
+    int wake_read = wake_pipe[0], wake_write = wake_pipe[1];
+    wake_pipe[0] = wake_pipe[1] = -1;  // Before closing, so a late signal writes nowhere
+    close(wake_read);
+    close(wake_write);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.ready);
+    pthread_cond_destroy(&queue.space);
+    free(workers);
+    free(ids);
+    free(queue.pending);
+    free(queue.active);
+    return started == 0 ? -1 : 0;
+}
+
+int serve(const char *path, const Table *table, const Config *config, OutputFormat format, int threads) {
+    if (strcmp(path, "-") == 0) {
+        serve_stream(stdin, stdout, stderr, table, config, format);
+        return 0;
+    }
+    return serve_socket(path, table, config, format, threads > SERVER_THREADS ? threads : SERVER_THREADS);
+}
@@ -0,0 +1,22 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "table.h"
+#include "output.h"
+
+// Number of clients served at once when -j does not ask for more
+#define SERVER_THREADS 4
+
+// Serve operation scripts against an already loaded table until the input
+// ends or the process is interrupted. Scripts use the same syntax as an
+// operations file and end with a line holding a single "." (or at the end of
+// the input); the results of each script are followed by a "." line too.
+// If path is "-" scripts are read from stdin and answered on stdout,
+// otherwise a Unix domain socket is created at path and up to threads
+// clients are served concurrently. Each script runs against its own
+// selection over the shared table, which is never modified. Results are
+// written in the given format, which must be a text one. Returns 0 on
+// success and -1 if the server could not be started.
+int serve(const char *path, const Table *table, const Config *config, OutputFormat format, int threads);
+
+#endif
@@ -0,0 +1,367 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "csv.h"
+#include "snapshot.h"
+#include "index.h"
+#include "cache.h"
+
+#define SNAPSHOT_MAGIC "DEMOSNAP"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u  // Reads differently on a machine of the other endianness
+#define SNAPSHOT_ALIGN 64                // Alignment of every section in the file
+
+// Fixed header at the start of a snapshot. All offsets are from the start of the file.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t checksum;               // Over the header and the sections before the column data
+    uint64_t source_size;            // Size and modification time of the CSV file
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint32_t row_count;
+    uint32_t column_count;
+    uint32_t string_count;
+    uint32_t slot_count;
+    uint64_t columns_offset;         // SnapshotColumn[column_count]
+    uint64_t string_offsets_offset;  // uint32_t[string_count + 1], into the string bytes
+    uint64_t slots_offset;           // uint32_t[slot_count], the string pool's hash table
+    uint64_t strings_offset;         // NUL-terminated strings, in id order
+    uint64_t strings_size;
+    char reserved[16];
+} SnapshotHeader;
+
+// Description of one column; its values are row_count 4-byte values at data_offset
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t data_offset;
+    char name[112];
+} SnapshotColumn;
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+// 64-bit multiply/xor hash continuing from hash, eight bytes at a time
+static uint64_t checksum(uint64_t hash, const unsigned char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Function to checksum the header, with its checksum field zeroed, and the
+// sections up to the end of the strings. The column data, which is most of
+// the file, is left out so that loading does not read every page of it.
+static uint64_t metadata_checksum(const SnapshotHeader *header, const char *data) {
+    SnapshotHeader copy = *header;
+    copy.checksum = 0;
+    uint64_t hash = checksum(0xcbf29ce484222325ULL, (const unsigned char *)&copy, sizeof(copy));
+    return checksum(hash, (const unsigned char *)data + sizeof(copy), header->strings_offset + header->strings_size - sizeof(copy));
+}
+
+// Write size bytes, then zeros up to the next section boundary
+static int write_section(FILE *file, const void *data, size_t size, uint64_t *pos) {
+    static const char zeros[SNAPSHOT_ALIGN];
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return 0;
+    }
+    *pos += size;
+    size_t padding = align_offset(*pos) - *pos;
+    if (padding > 0 && fwrite(zeros, 1, padding, file) != padding) {
+        return 0;
+    }
+    *pos += padding;
+    return 1;
+}
+
+// Function to write the table into a temporary file and move it into place
+int snapshot_save(const char *path, const Table *table, const Config *config, const char *source_file) {
+    struct stat source;
+    if (stat(source_file, &source) != 0) {
+        fprintf(stderr, "Could not stat %s, snapshot not written\n", source_file);
+        return 0;
+    }
+    for (int i = 0; i < table->column_count; i++) {
+        if (column_data(&table->columns[i]) == NULL) {
+            fprintf(stderr, "Not every column is loaded, snapshot not written\n");
+            return 0;
+        }
+    }
+
+    const StringPool *pool = &table->strings;
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.source_size = (uint64_t)source.st_size;
+    header.source_mtime_sec = (int64_t)source.st_mtim.tv_sec;
+    header.source_mtime_nsec = (int64_t)source.st_mtim.tv_nsec;
+    header.row_count = (uint32_t)table->row_count;
+    header.column_count = (uint32_t)table->column_count;
+    header.string_count = pool->count;
+    header.slot_count = pool->slot_count;
+
+    // Lay out the sections
+    uint32_t *string_offsets = malloc((pool->count + 1) * sizeof(uint32_t));
+    SnapshotColumn *columns = calloc(table->column_count > 0 ? table->column_count : 1, sizeof(SnapshotColumn));
+    if (string_offsets == NULL || columns == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(string_offsets);
+        free(columns);
+        return 0;
+    }
+    string_offsets[0] = 0;
+    for (uint32_t id = 0; id < pool->count; id++) {
+        string_offsets[id + 1] = string_offsets[id] + pool->lengths[id] + 1;
+    }
+
+    header.columns_offset = align_offset(sizeof(header));
+    header.string_offsets_offset = align_offset(header.columns_offset + table->column_count * sizeof(SnapshotColumn));
+    header.slots_offset = align_offset(header.string_offsets_offset + (pool->count + 1) * sizeof(uint32_t));
+    header.strings_offset = align_offset(header.slots_offset + pool->slot_count * sizeof(uint32_t));
+    header.strings_size = string_offsets[pool->count];
+    uint64_t offset = align_offset(header.strings_offset + header.strings_size);
+    for (int i = 0; i < table->column_count; i++) {
+        columns[i].type = table->columns[i].type;
+        columns[i].data_offset = offset;
+        snprintf(columns[i].name, sizeof(columns[i].name), "%s", config->valid_fields[i]);
+        offset = align_offset(offset + (uint64_t)table->row_count * sizeof(uint32_t));
+    }
+    header.file_size = offset;
+
+    // Write everything to a temporary file first so readers never see a partial snapshot
+    size_t path_length = strlen(path);
+    char *temp_path = malloc(path_length + 5);
+    if (temp_path == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(string_offsets);
+        free(columns);
+        return 0;
+    }
+    memcpy(temp_path, path, path_length);
+    memcpy(temp_path + path_length, ".tmp", 5);
+
+    FILE *file = fopen(temp_path, "wb");
+    int ok = file != NULL;
+    uint64_t pos = 0;
+    ok = ok && write_section(file, &header, sizeof(header), &pos);
+    ok = ok && write_section(file, columns, table->column_count * sizeof(SnapshotColumn), &pos);
+    ok = ok && write_section(file, string_offsets, (pool->count + 1) * sizeof(uint32_t), &pos);
+    ok = ok && write_section(file, pool->slots, pool->slot_count * sizeof(uint32_t), &pos);
+    for (uint32_t id = 0; ok && id < pool->count; id++) {
+        ok = fwrite(pool->strings[id], 1, pool->lengths[id] + 1, file) == pool->lengths[id] + 1;
+        pos += pool->lengths[id] + 1;
+    }
+    ok = ok && write_section(file, NULL, 0, &pos);
+    for (int i = 0; ok && i < table->column_count; i++) {
+        ok = write_section(file, column_data(&table->columns[i]), (size_t)table->row_count * sizeof(uint32_t), &pos);
+    }
+    if (file != NULL && fclose(file) != 0) {
+        ok = 0;
+    }
+
+    // Fill in the checksum now that the sections are on disk
+    if (ok) {
+        MappedFile written;
+        ok = map_file(temp_path, &written) && written.size == header.file_size;
+        if (ok) {
+            header.checksum = metadata_checksum(&header, written.data);
+            unmap_file(&written);
+            file = fopen(temp_path, "r+b");
+            ok = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1;
+            if (file != NULL && fclose(file) != 0) {
+                ok = 0;
+            }
+        }
+    }
+    ok = ok && rename(temp_path, path) == 0;
+
+    if (!ok) {
+        fprintf(stderr, "Could not write snapshot: %s\n", path);
+        remove(temp_path);
+    }
+    free(temp_path);
+    free(string_offsets);
+    free(columns);
+    return ok;
+}
+
+// Whether size bytes at offset lie inside a file of file_size bytes
+static int section_fits(uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && size <= file_size - offset;
+}
+
+// Function to check that a mapped snapshot is intact and matches the source
+// file and fields. Everything the load points into is bounds-checked: the
+// sections, the string offsets, the hash slots and the string id of every
+// row, so a damaged file that still passes the checksum cannot make the
+// table read outside the mapping.
+static const char *validate(const MappedFile *file, const Config *config, const char *source_file) {
+    const SnapshotHeader *header = (const SnapshotHeader *)file->data;
+    if (file->size < sizeof(SnapshotHeader) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        return "not a snapshot file";
+    }
+    if (header->version != SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER) {
+        return "written by an incompatible version";
+    }
+    if (header->file_size != file->size) {
+        return "truncated";
+    }
+
+    struct stat source;
+    if (stat(source_file, &source) != 0) {
+        return "source file is missing";
+    }
+    if (header->source_size != (uint64_t)source.st_size
+        || header->source_mtime_sec != (int64_t)source.st_mtim.tv_sec
+        || header->source_mtime_nsec != (int64_t)source.st_mtim.tv_nsec) {
+        return "out of date";
+    }
+
+    // Every section must lie inside the file, and the pool's hash table
+    // must be at most half full, as the pool keeps it
+    uint64_t column_bytes = (uint64_t)header->row_count * sizeof(uint32_t);
+    if (header->column_count != (uint32_t)config->valid_fields_count
+        || header->row_count > INT_MAX
+        || !section_fits(header->columns_offset, (uint64_t)header->column_count * sizeof(SnapshotColumn), file->size)
+        || !section_fits(header->string_offsets_offset, (header->string_count + 1ULL) * sizeof(uint32_t), file->size)
+        || !section_fits(header->slots_offset, (uint64_t)header->slot_count * sizeof(uint32_t), file->size)
+        || header->strings_offset < sizeof(SnapshotHeader)
+        || !section_fits(header->strings_offset, header->strings_size, file->size)
+        || header->columns_offset % SNAPSHOT_ALIGN != 0 || header->string_offsets_offset % SNAPSHOT_ALIGN != 0
+        || header->slots_offset % SNAPSHOT_ALIGN != 0
+        || header->string_count == 0
+        || (header->slot_count & (header->slot_count - 1)) != 0
+        || header->slot_count < 2ULL * header->string_count) {
+        return "damaged";
+    }
+    if (metadata_checksum(header, file->data) != header->checksum) {
+        return "checksum mismatch";
+    }
+
+    const SnapshotColumn *columns = (const SnapshotColumn *)(file->data + header->columns_offset);
+    for (int i = 0; i < config->valid_fields_count; i++) {
+        if (columns[i].type != (uint32_t)config->field_types[i]
+            || strncmp(columns[i].name, config->valid_fields[i], sizeof(columns[i].name)) != 0) {
+            return "built for different fields";
+        }
+        if (!section_fits(columns[i].data_offset, column_bytes, file->size) || columns[i].data_offset % SNAPSHOT_ALIGN != 0) {
+            return "damaged";
+        }
+    }
+
+    // Each string must end inside the string bytes, with its NUL
+    const uint32_t *string_offsets = (const uint32_t *)(file->data + header->string_offsets_offset);
+    const char *strings = file->data + header->strings_offset;
+    if (string_offsets[0] != 0) {
+        return "damaged";
+    }
+    for (uint32_t id = 0; id < header->string_count; id++) {
+        uint32_t end = string_offsets[id + 1];
+        if (end <= string_offsets[id] || end > header->strings_size || strings[end - 1] != '\0') {
+            return "damaged";
+        }
+    }
+    const uint32_t *slots = (const uint32_t *)(file->data + header->slots_offset);
+    for (uint32_t slot = 0; slot < header->slot_count; slot++) {
+        if (slots[slot] > header->string_count) {
+            return "damaged";
+        }
+    }
+
+    // String columns hold ids into the pool
+    for (int i = 0; i < config->valid_fields_count; i++) {
+        if (columns[i].type != FIELD_STRING) {
+            continue;
+        }
+        const uint32_t *ids = (const uint32_t *)(file->data + columns[i].data_offset);
+        for (uint32_t row = 0; row < header->row_count; row++) {
+            if (ids[row] >= header->string_count) {
+                return "damaged";
+            }
+        }
+    }
+    return NULL;
+}
+
+int snapshot_load(const char *path, Table *table, const Config *config, const char *source_file) {
+    MappedFile file;
+    memset(table, 0, sizeof(*table));
+
+    if (!map_file(path, &file)) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "Could not open snapshot: %s\n", path);
+        }
+        return 0;
+    }
+
+    const char *problem = validate(&file, config, source_file);
+    if (problem != NULL) {
+        fprintf(stderr, "Ignoring snapshot %s: %s\n", path, problem);
+        unmap_file(&file);
+        return 0;
+    }
+
+    const SnapshotHeader *header = (const SnapshotHeader *)file.data;
+    const SnapshotColumn *columns = (const SnapshotColumn *)(file.data + header->columns_offset);
+    const uint32_t *string_offsets = (const uint32_t *)(file.data + header->string_offsets_offset);
+    const char *strings = file.data + header->strings_offset;
+
+    // The column arrays stay in the mapping; only the pool's index is rebuilt
+    arena_init(&table->arena, ARENA_SLAB_SIZE);
+    string_pool_init(&table->strings);
+    StringPool *pool = &table->strings;
+    pool->strings = malloc(header->string_count * sizeof(char *));
+    pool->lengths = malloc(header->string_count * sizeof(uint32_t));
+    pool->slots = malloc(header->slot_count * sizeof(uint32_t));
+    table->columns = arena_alloc(&table->arena, header->column_count * sizeof(Column), sizeof(void *));
+    table->index = table_index_create(header->column_count);
+    table->cache = filter_cache_create(FILTER_CACHE_BYTES);
+    if (pool->strings == NULL || pool->lengths == NULL || pool->slots == NULL || table->columns == NULL || table->index == NULL
+        || table->cache == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        table_free(table);
+        unmap_file(&file);
+        return 0;
+    }
+    for (uint32_t id = 0; id < header->string_count; id++) {
+        pool->strings[id] = strings + string_offsets[id];
+        pool->lengths[id] = string_offsets[id + 1] - string_offsets[id] - 1;
+    }
+    memcpy(pool->slots, file.data + header->slots_offset, header->slot_count * sizeof(uint32_t));
+    pool->count = pool->capacity = header->string_count;
+    pool->slot_count = header->slot_count;
+
+    for (uint32_t i = 0; i < header->column_count; i++) {
+        Column *column = &table->columns[i];
+        void *data = (void *)(file.data + columns[i].data_offset);
+        memset(column, 0, sizeof(*column));
+        column->type = (FieldType)columns[i].type;
+        switch (column->type) {
+            case FIELD_STRING: column->strings = data; break;
+            case FIELD_FLOAT: column->floats = data; break;
+            case FIELD_INT: column->ints = data; break;
+        }
+    }
+    table->row_count = table->capacity = (int)header->row_count;
+    table->column_count = (int)header->column_count;
+    table->backing = file;
+    return 1;
+}
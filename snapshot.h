@@ -0,0 +1,18 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "table.h"
+
+#define SNAPSHOT_VERSION 2
+
+// Write the loaded table to a binary snapshot file. The size and modification
+// time of source_file are recorded so that a stale snapshot can be detected.
+// Returns 1 on success.
+int snapshot_save(const char *path, const Table *table, const Config *config, const char *source_file);
+
+// Map a snapshot and point the table's columns straight into it. Returns 1 on
+// success and 0 if the snapshot is missing, damaged, built for other fields,
+// or older than source_file (the reason is reported on stderr).
+int snapshot_load(const char *path, Table *table, const Config *config, const char *source_file);
+
+#endif
@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "sort.h"
+#include "index.h"
+
+// A row to order, as one number: the key of its value (complemented for a
+// descending order) in the high 32 bits and the row in the low 32 bits.
+// Rows of equal value then order by row, and no two keys are equal, so any
+// way of sorting them gives the same order.
+typedef uint64_t SortKey;
+
+// One thread's share of the selected rows
+typedef struct {
+    const Table *table;
+    const Selection *selection;
+    const uint32_t *ranks;  // String columns: position of each string id in strcmp order
+    int column;
+    int descending;
+    int limit;
+    int first_word;
+    int last_word;
+    SortKey *keys;          // The share's sorted keys, at most limit of them
+    int count;
+    uint32_t *nans;         // Rows whose value is NaN, in row order
+    int nan_count;
+    int failed;             // Memory ran out
+} SortShare;
+
+// Two sorted runs to merge into one, keeping at most limit keys
+typedef struct {
+    const SortKey *a;
+    int a_count;
+    const SortKey *b;
+    int b_count;
+    int limit;
+    SortKey *keys;
+    int count;
+} SortMerge;
+
+// A string and its id, to rank the strings of the pool
+typedef struct {
+    const char *text;
+    uint32_t id;
+} NamedString;
+
+static int compare_named(const void *a, const void *b) {
+    return strcmp(((const NamedString *)a)->text, ((const NamedString *)b)->text);
+}
+
+static int compare_keys(const void *a, const void *b) {
+    SortKey x = *(const SortKey *)a, y = *(const SortKey *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Function to rank the strings the selected rows of a string column hold:
+// ranks[id] is the position of string id among them in strcmp order.
+// Returns NULL if memory ran out.
+static uint32_t *string_ranks(const Table *table, const Selection *selection, const Column *column) {
+    uint32_t count = table->strings.count, distinct = 0;
+    for (int w = 0; w < SELECTION_WORDS(selection->row_count); w++) {
+        distinct += __builtin_popcountll(selection->bits[w]);
+    }
+    distinct = distinct < count ? distinct : count;
+    NamedString *named = malloc((distinct > 0 ? distinct : 1) * sizeof(NamedString));
+    uint32_t *ranks = calloc(count > 0 ? count : 1, sizeof(uint32_t));  // 1 marks a string seen
+    if (named == NULL || ranks == NULL) {
+        free(named);
+        free(ranks);
+        return NULL;
+    }
+    distinct = 0;
+    for (int row = selection_next(selection, 0); row >= 0; row = selection_next(selection, row + 1)) {
+        uint32_t id = column->strings[row];
+        if (!ranks[id]) {
+            ranks[id] = 1;
+            named[distinct].text = string_pool_get(&table->strings, id);
+            named[distinct++].id = id;
+        }
+    }
+    qsort(named, distinct, sizeof(NamedString), compare_named);
+    for (uint32_t i = 0; i < distinct; i++) {
+        ranks[named[i].id] = i;
+    }
+    free(named);
+    return ranks;
+}
+
+// Function to find the key of a row's value. Returns 0 if the value is NaN.
+static int value_key(const SortShare *share, int row, uint32_t *key) {
+    const Column *column = &share->table->columns[share->column];
+    switch (column->type) {
+        case FIELD_STRING:
+            *key = share->ranks[column->strings[row]];
+            break;
+        case FIELD_INT:
+            *key = index_int_key(column->ints[row]);
+            break;
+        default:
+            if (isnan(column->floats[row])) return 0;
+            *key = index_float_key(column->floats[row]);
+            break;
+    }
+    if (share->descending) {
+        *key = ~*key;
+    }
+    return 1;
+}
+
+// Function to sort keys that are in row order by their value keys: a
+// stable radix sort on the high 32 bits, 8 at a time, skipping the digits
+// all keys share. buffer must hold count keys.
+static void radix_sort(SortKey *keys, SortKey *buffer, int count) {
+    SortKey *from = keys, *to = buffer;
+    for (int shift = 32; shift < 64; shift += 8) {
+        int offsets[257] = { 0 };
+        for (int i = 0; i < count; i++) {
+            offsets[((from[i] >> shift) & 0xff) + 1]++;
+        }
+        int shared = 0;
+        for (int digit = 1; digit <= 256; digit++) {
+            shared |= offsets[digit] == count;
+            offsets[digit] += offsets[digit - 1];
+        }
+        if (shared) continue;
+        for (int i = 0; i < count; i++) {
+            to[offsets[(from[i] >> shift) & 0xff]++] = from[i];
+        }
+        SortKey *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != keys) {
+        memcpy(keys, from, count * sizeof(SortKey));
+    }
+}
+
+// Function to offer a key to a max-heap of the size smallest keys so far
+static void heap_offer(SortKey *heap, int *size, int limit, SortKey key) {
+    int i;
+    if (*size < limit) {
+        // Sift the new key up from the bottom
+        i = (*size)++;
+        while (i > 0 && heap[(i - 1) / 2] < key) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = key;
+        return;
+    }
+    if (limit == 0 || key >= heap[0]) {
+        return;
+    }
+    // Replace the largest key and sift it down
+    i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *size) break;
+        if (child + 1 < *size && heap[child + 1] > heap[child]) child++;
+        if (heap[child] <= key) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = key;
+}
+
+// Function to sort the rows of one share: all of them with a radix sort, or
+// the first limit of them with a heap when that is a small part
+static void *sort_share(void *arg) {
+    SortShare *share = arg;
+    const uint64_t *bits = share->selection->bits;
+    int count = 0;
+    for (int w = share->first_word; w < share->last_word; w++) {
+        count += __builtin_popcountll(bits[w]);
+    }
+    int partial = share->limit >= 0 && (int64_t)share->limit * 8 < count;
+    share->keys = malloc((partial ? share->limit + 1 : count + 1) * sizeof(SortKey));
+    share->nans = share->limit < 0 ? malloc((count + 1) * sizeof(uint32_t)) : NULL;
+    if (share->keys == NULL || (share->limit < 0 && share->nans == NULL)) {
+        share->failed = 1;
+        return NULL;
+    }
+
+    for (int w = share->first_word; w < share->last_word; w++) {
+        for (uint64_t b = bits[w]; b != 0; b &= b - 1) {
+            int row = w * 64 + __builtin_ctzll(b);
+            uint32_t key;
+            if (!value_key(share, row, &key)) {
+                if (share->nans != NULL) share->nans[share->nan_count++] = (uint32_t)row;
+                continue;
+            }
+            SortKey sort_key = (SortKey)key << 32 | (uint32_t)row;
+            if (partial) {
+                heap_offer(share->keys, &share->count, share->limit, sort_key);
+            } else {
+                share->keys[share->count++] = sort_key;
+            }
+        }
+    }
+
+    if (partial) {
+        qsort(share->keys, share->count, sizeof(SortKey), compare_keys);
+        return NULL;
+    }
+    SortKey *buffer = malloc((share->count + 1) * sizeof(SortKey));
+    if (buffer == NULL) {
+        share->failed = 1;
+        return NULL;
+    }
+    radix_sort(share->keys, buffer, share->count);
+    free(buffer);
+    if (share->limit >= 0 && share->count > share->limit) {
+        share->count = share->limit;
+    }
+    return NULL;
+}
+
+// Function to merge two sorted runs, up to the limit
+static void *merge_runs(void *arg) {
+    SortMerge *merge = arg;
+    int i = 0, j = 0;
+    while (merge->count < merge->limit && (i < merge->a_count || j < merge->b_count)) {
+        if (j == merge->b_count || (i < merge->a_count && merge->a[i] < merge->b[j])) {
+            merge->keys[merge->count++] = merge->a[i++];
+        } else {
+            merge->keys[merge->count++] = merge->b[j++];
+        }
+    }
+    return NULL;
+}
+
+// Function to run fn on count items of the given size, one thread per item
+static void run_parallel(void *items, int count, size_t size, void *(*fn)(void *)) {
+    pthread_t *workers = malloc(count * sizeof(pthread_t));
+    int *started = calloc(count, sizeof(int));
+    for (int i = 1; workers != NULL && started != NULL && i < count; i++) {
+        started[i] = pthread_create(&workers[i], NULL, fn, (char *)items + i * size) == 0;
+    }
+    if (count > 0) {
+        fn(items);
+    }
+    for (int i = 1; i < count; i++) {
+        if (started != NULL && started[i]) {
+            pthread_join(workers[i], NULL);
+        } else {
+            fn((char *)items + i * size);  // Could not start a thread, do its work here instead
+        }
+    }
+    free(workers);
+    free(started);
+}
+
+// Function to merge the sorted runs of the shares into the first one, in
+// rounds that merge neighbouring pairs in parallel. Returns 0 if memory ran out.
+static int merge_shares(SortShare *shares, int share_count, int limit) {
+    SortMerge *merges = calloc(share_count / 2 + 1, sizeof(SortMerge));
+    if (merges == NULL) {
+        return 0;
+    }
+    while (share_count > 1) {
+        int merge_count = share_count / 2;
+        int ok = 1;
+        for (int m = 0; m < merge_count; m++) {
+            SortMerge *merge = &merges[m];
+            const SortShare *a = &shares[2 * m], *b = &shares[2 * m + 1];
+            merge->a = a->keys;
+            merge->a_count = a->count;
+            merge->b = b->keys;
+            merge->b_count = b->count;
+            merge->limit = a->count + b->count;
+            if (limit >= 0 && limit < merge->limit) merge->limit = limit;
+            merge->keys = malloc((merge->limit + 1) * sizeof(SortKey));
+            merge->count = 0;
+            ok = ok && merge->keys != NULL;
+        }
+        if (ok) {
+            run_parallel(merges, merge_count, sizeof(SortMerge), merge_runs);
+        }
+
+        // The merged runs replace their pairs; an odd last share moves along
+        for (int m = 0; m < merge_count; m++) {
+            free(shares[2 * m].keys);
+            free(shares[2 * m + 1].keys);
+            shares[m].keys = merges[m].keys;
+            shares[m].count = merges[m].count;
+        }
+        if (share_count % 2 != 0) {
+            shares[merge_count].keys = shares[share_count - 1].keys;
+            shares[merge_count].count = shares[share_count - 1].count;
+        }
+        for (int s = (share_count + 1) / 2; s < share_count; s++) {
+            shares[s].keys = NULL;
+        }
+        share_count = (share_count + 1) / 2;
+        if (!ok) {
+            free(merges);
+            return 0;
+        }
+    }
+    free(merges);
+    return 1;
+}
+
+int sort_rows(const Table *table, const Selection *selection, int column, int descending, int limit, int threads,
+              uint32_t **rows) {
+    int words = SELECTION_WORDS(selection->row_count);
+    int share_count = threads < words / SORT_MIN_WORDS ? threads : words / SORT_MIN_WORDS;
+    if (share_count < 1) share_count = 1;
+    *rows = NULL;
+
+    SortShare *shares = calloc(share_count, sizeof(SortShare));
+    const Column *values = &table->columns[column];
+    uint32_t *ranks = values->type == FIELD_STRING ? string_ranks(table, selection, values) : NULL;
+    if (shares == NULL || (values->type == FIELD_STRING && ranks == NULL)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(shares);
+        free(ranks);
+        return -1;
+    }
+
+    // Every share gets an even part of the words
+    for (int s = 0; s < share_count; s++) {
+        SortShare *share = &shares[s];
+        share->table = table;
+        share->selection = selection;
+        share->ranks = ranks;
+        share->column = column;
+        share->descending = descending;
+        share->limit = limit;
+        share->first_word = (int)((int64_t)words * s / share_count);
+        share->last_word = (int)((int64_t)words * (s + 1) / share_count);
+    }
+    run_parallel(shares, share_count, sizeof(SortShare), sort_share);
+
+    int failed = 0, nan_count = 0;
+    for (int s = 0; s < share_count; s++) {
+        failed |= shares[s].failed;
+        nan_count += shares[s].nan_count;
+    }
+    int count = -1;
+    if (!failed && merge_shares(shares, share_count, limit)) {
+        // The rows of the merged keys, then the NaNs of each share in turn
+        count = shares[0].count + nan_count;
+        *rows = count > 0 ? malloc(count * sizeof(uint32_t)) : NULL;
+        if (count > 0 && *rows == NULL) {
+            count = -1;
+        }
+        for (int i = 0; count > 0 && i < shares[0].count; i++) {
+            (*rows)[i] = (uint32_t)shares[0].keys[i];
+        }
+        for (int s = 0, i = shares[0].count; count > 0 && s < share_count; s++) {
+            if (shares[s].nan_count > 0) {
+                memcpy(*rows + i, shares[s].nans, shares[s].nan_count * sizeof(uint32_t));
+                i += shares[s].nan_count;
+            }
+        }
+    }
+    if (count < 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+    }
+
+    for (int s = 0; s < share_count; s++) {
+        free(shares[s].keys);
+        free(shares[s].nans);
+    }
+    free(shares);
+    free(ranks);
+    return count;
+}
@@ -0,0 +1,24 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stdint.h>
+
+#include "table.h"
+
+// Selections of at least this many words are shared between threads
+#define SORT_MIN_WORDS 1024
+
+// Order the selected rows by the value of a column, ascending or descending,
+// with rows of equal value in row order. Strings compare with strcmp.
+// With limit >= 0 only the first limit rows are kept and rows whose value is
+// NaN are left out; otherwise every selected row is kept and NaNs come last.
+// Only row numbers are moved: each of up to threads threads orders its share
+// of the rows (partially, with a heap, when only limit rows are wanted) and
+// the shares are merged in pairs, the pairs in parallel. The order is the
+// same whatever the number of threads.
+// Returns the number of rows written to *rows (malloc'd; NULL when there
+// are none), or -1 if memory ran out.
+int sort_rows(const Table *table, const Selection *selection, int column, int descending, int limit, int threads,
+              uint32_t **rows);
+
+#endif
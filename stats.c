@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static double seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void stats_init(Stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->start = stats_now(stats);
+    stats->source = "csv";
+}
+
+void stats_free(Stats *stats) {
+    free(stats->passes);
+    free(stats->operations);
+    stats->passes = NULL;
+    stats->operations = NULL;
+}
+
+StatsTime stats_now(const Stats *stats) {
+    StatsTime now = { 0.0, 0.0 };
+    if (stats != NULL) {
+        now.wall = seconds(CLOCK_MONOTONIC);
+        now.cpu = seconds(CLOCK_PROCESS_CPUTIME_ID);
+    }
+    return now;
+}
+
+void stats_phase(Stats *stats, const char *name, StatsTime start) {
+    if (stats == NULL) return;
+    StatsTime now = stats_now(stats);
+    int i = 0;
+    while (i < stats->phase_count && strcmp(stats->phases[i].name, name) != 0) {
+        i++;
+    }
+    if (i == stats->phase_count) {
+        if (i == (int)(sizeof(stats->phases) / sizeof(stats->phases[0]))) return;
+        stats->phases[stats->phase_count++].name = name;
+    }
+    stats->phases[i].wall += now.wall - start.wall;
+    stats->phases[i].cpu += now.cpu - start.cpu;
+}
+
+int stats_pass(Stats *stats, StatsTime start) {
+    if (stats == NULL) return -1;
+    StatsTime now = stats_now(stats);
+    StatsTime *passes = realloc(stats->passes, (stats->pass_count + 1) * sizeof(StatsTime));
+    if (passes == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    stats->passes = passes;
+    passes[stats->pass_count].wall = now.wall - start.wall;
+    passes[stats->pass_count].cpu = now.cpu - start.cpu;
+    return stats->pass_count++;
+}
+
+int stats_operation(Stats *stats, const StatsOperation *operation) {
+    if (stats == NULL) return 1;
+    if (stats->operation_count == stats->operation_capacity) {
+        int capacity = stats->operation_capacity ? stats->operation_capacity * 2 : 16;
+        StatsOperation *grown = realloc(stats->operations, capacity * sizeof(StatsOperation));
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 0;
+        }
+        stats->operations = grown;
+        stats->operation_capacity = capacity;
+    }
+    stats->operations[stats->operation_count++] = *operation;
+    return 1;
+}
+
+// Function to write a JSON string, escaping quotes, backslashes and control characters
+static void write_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)(text != NULL ? text : ""); *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c == '\n') {
+            fputs("\\n", out);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_time(FILE *out, double wall, double cpu) {
+    fprintf(out, "\"wall_ms\": %.3f, \"cpu_ms\": %.3f", wall * 1e3, cpu * 1e3);
+}
+
+int stats_write(const Stats *stats, const char *path) {
+    FILE *out = path != NULL ? fopen(path, "w") : stderr;
+    if (out == NULL) {
+        fprintf(stderr, "Could not open file: %s\n", path);
+        return 0;
+    }
+    StatsTime now = stats_now(stats);
+
+    fputs("{\n  \"file\": ", out);
+    write_string(out, stats->file);
+    fputs(",\n  \"source\": ", out);
+    write_string(out, stats->source);
+    fputs(",\n  \"kernels\": ", out);
+    write_string(out, stats->kernels);
+    fprintf(out, ",\n  \"threads\": %d,\n", stats->threads);
+    fprintf(out, "  \"bytes_read\": %lld,\n", stats->bytes_read);
+    fprintf(out, "  \"rows_parsed\": %d,\n", stats->rows_parsed);
+    fprintf(out, "  \"rows_loaded\": %d,\n", stats->rows_loaded);
+    fprintf(out, "  \"rows_malformed\": %d,\n", stats->rows_malformed);
+    fprintf(out, "  \"columns_loaded\": %d,\n", stats->columns_loaded);
+    fputs("  \"total\": {", out);
+    write_time(out, now.wall - stats->start.wall, now.cpu - stats->start.cpu);
+    fputs("},\n  \"phases\": [", out);
+    for (int i = 0; i < stats->phase_count; i++) {
+        fputs(i > 0 ? ",\n    {\"name\": " : "\n    {\"name\": ", out);
+        write_string(out, stats->phases[i].name);
+        fputs(", ", out);
+        write_time(out, stats->phases[i].wall, stats->phases[i].cpu);
+        fputc('}', out);
+    }
+    fputs(stats->phase_count > 0 ? "\n  ],\n  \"passes\": [" : "],\n  \"passes\": [", out);
+    for (int i = 0; i < stats->pass_count; i++) {
+        fprintf(out, "%s    {\"pass\": %d, ", i > 0 ? ",\n" : "\n", i);
+        write_time(out, stats->passes[i].wall, stats->passes[i].cpu);
+        fputc('}', out);
+    }
+    fputs(stats->pass_count > 0 ? "\n  ],\n  \"operations\": [" : "],\n  \"operations\": [", out);
+    for (int i = 0; i < stats->operation_count; i++) {
+        const StatsOperation *op = &stats->operations[i];
+        fprintf(out, "%s    {\"line\": %d, \"operation\": ", i > 0 ? ",\n" : "\n", op->line);
+        write_string(out, op->text);
+        if (op->pass >= 0) {
+            fprintf(out, ", \"pass\": %d", op->pass);
+        }
+        fprintf(out, ", \"rows_in\": %d, \"rows_out\": %d, \"selectivity\": %.6f",
+                op->rows_in, op->rows_out, op->rows_in > 0 ? (double)op->rows_out / op->rows_in : 0.0);
+        if (op->groups >= 0) {
+            fprintf(out, ", \"groups\": %d", op->groups);
+        }
+        fputc('}', out);
+    }
+    fputs(stats->operation_count > 0 ? "\n  ]\n}\n" : "]\n}\n", out);
+
+    if (path != NULL) {
+        if (fclose(out) != 0) {
+            fprintf(stderr, "Could not write %s\n", path);
+            return 0;
+        }
+    } else {
+        fflush(out);
+    }
+    return 1;
+}
@@ -0,0 +1,76 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+// A point in time, as wall clock and as CPU time used by the whole process
+// (all threads)
+typedef struct {
+    double wall;
+    double cpu;
+} StatsTime;
+
+// Time spent in one named phase of the run
+typedef struct {
+    const char *name;
+    double wall;
+    double cpu;
+} StatsPhase;
+
+// What one line of the operations file did. Filters narrow the selection
+// from rows_in to rows_out; other lines leave it as it is.
+typedef struct {
+    int line;          // Line number in the operations file
+    int pass;          // Pass over the data the line was evaluated in
+    char text[256];    // The operation as compiled
+    int rows_in;
+    int rows_out;
+    int groups;        // Grouped aggregates: number of groups, otherwise -1
+} StatsOperation;
+
+// Timings and counters of a run, written out as JSON at the end. Every
+// stats_ function accepts NULL and then does nothing, so a run without
+// --stats pays for a pointer test per phase and per pass, never per row.
+typedef struct {
+    StatsTime start;
+    StatsPhase phases[16];
+    int phase_count;
+    StatsTime *passes;   // Time of each pass over the data
+    int pass_count;
+    StatsOperation *operations;
+    int operation_count;
+    int operation_capacity;
+
+    // Input, filled in by the caller
+    const char *file;
+    const char *source;  // "csv", "snapshot" or "stream"
+    long long bytes_read;
+    int rows_parsed;
+    int rows_loaded;
+    int rows_malformed;
+    int columns_loaded;
+    int threads;
+    const char *kernels;
+} Stats;
+
+void stats_init(Stats *stats);
+void stats_free(Stats *stats);
+
+// Current time, or zero if stats is NULL
+StatsTime stats_now(const Stats *stats);
+
+// Add the time since start to the named phase. Phases keep the order they
+// were first seen in; the name must outlive the stats.
+void stats_phase(Stats *stats, const char *name, StatsTime start);
+
+// Record a pass over the data that began at start. Returns its number, or -1.
+int stats_pass(Stats *stats, StatsTime start);
+
+// Record one operation. Returns 0 if memory ran out.
+int stats_operation(Stats *stats, const StatsOperation *operation);
+
+// Write the stats as one JSON object to path, or to stderr if path is NULL.
+// Returns 0 if the file could not be written.
+int stats_write(const Stats *stats, const char *path);
+
+#endif
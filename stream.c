@@ -0,0 +1,57 @@
+#include <stdio.h>
+
+#include "stream.h"
+#include "plan.h"
+
+int stream_operations(const char *operations_file, DemographicsFile *input, const Config *config, const unsigned char *load, Output *out, Stats *stats) {
+    FILE *file = fopen(operations_file, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file: %s\n", operations_file);
+        return -1;
+    }
+
+    // No table yet: states are bound to string ids as the blocks bring them
+    Plan plan;
+    StatsTime start = stats_now(stats);
+    int compiled = plan_compile(&plan, file, NULL, config);
+    stats_phase(stats, "compile", start);
+    fclose(file);
+    if (!compiled) {
+        return -1;
+    }
+    if (plan.display || plan.order >= 0 || plan.join_count > 0) {
+        fprintf(stderr, "Cannot stream an operations file that uses display, top, sort or join\n");
+        plan_free(&plan);
+        return -1;
+    }
+
+    const Table *table;
+    DemographicsStream *stream = open_demographics_stream(input, config, load, &table);
+    PlanRun *run = stream != NULL ? plan_run_begin(&plan, table, config, stats) : NULL;
+    int rows = 0;
+    int status = run != NULL ? 1 : -1;
+    while (status > 0) {
+        start = stats_now(stats);
+        status = next_demographics_block(stream);
+        stats_phase(stats, "parse", start);
+        if (status > 0) {
+            start = stats_now(stats);
+            status = plan_run_block(run) ? 1 : -1;
+            stats_phase(stats, "execute", start);
+            rows += table->row_count;
+        }
+    }
+
+    if (status == 0) {
+        output_loaded(out, rows);
+    }
+    if (run != NULL) {
+        if (status == 0) {
+            plan_run_end(run, config, out, stats);
+        }
+        plan_run_free(run);
+    }
+    close_demographics_stream(stream);
+    plan_free(&plan);
+    return status == 0 ? rows : -1;
+}
@@ -0,0 +1,18 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "table.h"
+#include "loader.h"
+#include "stats.h"
+#include "output.h"
+
+// Run an operations file while the demographics file is read, one block of
+// records at a time, instead of loading the whole table first. Memory use
+// is bounded by the block size and the distinct strings of the file, so
+// files larger than memory can be processed. The operations file must not
+// use display, which needs every selected row at the end. Writes the number
+// of records loaded and then the results, exactly as a load followed by the
+// operations would. Returns the number of records read or -1 on error.
+int stream_operations(const char *operations_file, DemographicsFile *input, const Config *config, const unsigned char *load, Output *out, Stats *stats);
+
+#endif
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+#include "index.h"
+#include "cache.h"
+
+int config_init(Config *config, const char **valid_fields, const char **print_formats, const FieldType *field_types, int count) {
+    config->capacity = count + 64;
+    config->valid_fields = malloc(config->capacity * sizeof(char *));
+    config->print_formats = malloc(config->capacity * sizeof(char *));
+    config->field_types = malloc(config->capacity * sizeof(FieldType));
+    if (config->valid_fields == NULL || config->print_formats == NULL || config->field_types == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        config->valid_fields_count = config->required_count = 0;
+        config_free(config);
+        return 0;
+    }
+    memcpy((void *)config->valid_fields, valid_fields, count * sizeof(char *));
+    memcpy((void *)config->print_formats, print_formats, count * sizeof(char *));
+    memcpy((void *)config->field_types, field_types, count * sizeof(FieldType));
+    config->valid_fields_count = config->required_count = count;
+    return 1;
+}
+
+int config_add_field(Config *config, const char *name, FieldType type) {
+    if (config->valid_fields_count == config->capacity) {
+        int capacity = config->capacity * 2;
+        const char **names = realloc((void *)config->valid_fields, capacity * sizeof(char *));
+        if (names != NULL) config->valid_fields = names;
+        const char **formats = realloc((void *)config->print_formats, capacity * sizeof(char *));
+        if (formats != NULL) config->print_formats = formats;
+        FieldType *types = realloc((void *)config->field_types, capacity * sizeof(FieldType));
+        if (types != NULL) config->field_types = types;
+        if (names == NULL || formats == NULL || types == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 0;
+        }
+        config->capacity = capacity;
+    }
+
+    char *copy = malloc(strlen(name) + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    strcpy(copy, name);
+    int i = config->valid_fields_count++;
+    config->valid_fields[i] = copy;
+    config->print_formats[i] = NULL;
+    ((FieldType *)config->field_types)[i] = type;
+    return 1;
+}
+
+void config_free(Config *config) {
+    // Only the names of the fields added from the header are owned
+    for (int i = config->required_count; i < config->valid_fields_count; i++) {
+        free((void *)config->valid_fields[i]);
+    }
+    free((void *)config->valid_fields);
+    free((void *)config->print_formats);
+    free((void *)config->field_types);
+    memset(config, 0, sizeof(*config));
+}
+
+// Function to find the column index of a field, or -1 if it is not a valid field
+int find_field(const Config *config, const char *field) {
+    for (int i = 0; i < config->valid_fields_count; i++) {
+        if (strcmp(field, config->valid_fields[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Function to allocate one array per column for up to capacity rows
+int table_init(Table *table, const Config *config, int capacity, const unsigned char *load) {
+    memset(table, 0, sizeof(*table));
+    table->capacity = capacity;
+    table->column_count = config->valid_fields_count;
+    arena_init(&table->arena, ARENA_SLAB_SIZE);
+    string_pool_init(&table->strings);
+
+    // String id 0 is always the empty string
+    table->columns = arena_alloc(&table->arena, config->valid_fields_count * sizeof(Column), sizeof(void *));
+    table->index = table_index_create(table->column_count);
+    table->cache = filter_cache_create(FILTER_CACHE_BYTES);
+    if (table->columns == NULL || table->index == NULL || table->cache == NULL || string_pool_intern(&table->strings, &table->arena, "", 0) != 0) {
+        table_free(table);
+        return 0;
+    }
+
+    for (int i = 0; i < table->column_count; i++) {
+        Column *column = &table->columns[i];
+        memset(column, 0, sizeof(*column));
+        column->type = config->field_types[i];
+        if (load != NULL && !load[i]) {
+            continue;
+        }
+
+        // Every value type is 4 bytes wide; keep the arrays cache line aligned
+        void *storage = arena_alloc(&table->arena, (capacity > 0 ? capacity : 1) * sizeof(uint32_t), 64);
+        if (storage == NULL) {
+            table_free(table);
+            return 0;
+        }
+        switch (column->type) {
+            case FIELD_STRING: column->strings = storage; break;
+            case FIELD_FLOAT: column->floats = storage; break;
+            case FIELD_INT: column->ints = storage; break;
+        }
+    }
+    return 1;
+}
+
+void table_free(Table *table) {
+    table_index_free(table->index);
+    table->index = NULL;
+    filter_cache_free(table->cache);
+    table->cache = NULL;
+    string_pool_free(&table->strings);
+    arena_free(&table->arena);
+    if (table->backing.data != NULL) {
+        unmap_file(&table->backing);
+    }
+    table->columns = NULL;
+    table->row_count = 0;
+    table->capacity = 0;
+    table->column_count = 0;
+}
+
+double column_value(const Column *column, int row) {
+    switch (column->type) {
+        case FIELD_FLOAT: return column->floats[row];
+        case FIELD_INT: return column->ints[row];
+        default: return 0.0;
+    }
+}
+
+// Function to create a selection containing every row
+int selection_init_all(Selection *selection, int row_count) {
+    int words = SELECTION_WORDS(row_count);
+    selection->bits = malloc((words > 0 ? words : 1) * sizeof(uint64_t));
+    if (selection->bits == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+
+    memset(selection->bits, 0xff, words * sizeof(uint64_t));
+    if (row_count % 64 != 0) {
+        selection->bits[words - 1] = (UINT64_C(1) << (row_count % 64)) - 1;
+    }
+    selection->row_count = row_count;
+    selection->count = row_count;
+    return 1;
+}
+
+void selection_free(Selection *selection) {
+    free(selection->bits);
+    selection->bits = NULL;
+    selection->row_count = 0;
+    selection->count = 0;
+}
+
+int selection_next(const Selection *selection, int row) {
+    if (row >= selection->row_count) return -1;
+
+    int word = row / 64;
+    uint64_t bits = selection->bits[word] & (~UINT64_C(0) << (row % 64));
+    int words = SELECTION_WORDS(selection->row_count);
+    while (bits == 0) {
+        if (++word >= words) return -1;
+        bits = selection->bits[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
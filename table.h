@@ -0,0 +1,112 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "csv.h"
+
+// Type of the values stored for a field
+typedef enum {
+    FIELD_STRING,
+    FIELD_FLOAT,
+    FIELD_INT
+} FieldType;
+
+// Define a structure to hold the valid fields and print formats. The first
+// required_count fields are the ones every record must hold valid values for,
+// and the ones display prints. The fields after them are the other columns
+// of the demographics file's header, read as floats.
+typedef struct {
+    const char **valid_fields;
+    const char **print_formats;
+    const FieldType *field_types;
+    int valid_fields_count;
+    int required_count;
+    int capacity;
+} Config;
+
+// Field holding the population every sub-population is computed from
+#define POPULATION_FIELD "Population.2014 Population"
+
+// One field of the dataset, stored contiguously for all rows. Only the
+// array matching the column type is allocated, and only if the column was
+// loaded. String columns hold ids of
+// strings interned in the table's string pool.
+typedef struct {
+    FieldType type;
+    float *floats;
+    int *ints;
+    uint32_t *strings;
+} Column;
+
+struct TableIndex;
+struct FilterCache;
+
+// Column-oriented (struct-of-arrays) storage for the demographics data.
+// columns[i] holds the values of config->valid_fields[i]. The column arrays
+// and the interned strings are allocated from the table's arena, unless the
+// table was loaded from a snapshot, in which case they point into backing.
+typedef struct {
+    int row_count;
+    int capacity;
+    int column_count;
+    Column *columns;
+    Arena arena;
+    StringPool strings;
+    MappedFile backing;
+    struct TableIndex *index;  // Secondary indexes over the columns (see index.h)
+    struct FilterCache *cache; // Selections left by chains of filters (see cache.h)
+} Table;
+
+// A set of selected rows, kept as a bitmap over the rows of a table so that
+// filters never have to move the data itself.
+typedef struct {
+    uint64_t *bits;
+    int row_count;  // Number of rows the bitmap covers
+    int count;      // Number of rows currently selected
+} Selection;
+
+// Words needed for a bitmap over row_count rows
+#define SELECTION_WORDS(row_count) (((row_count) + 63) / 64)
+
+// Start a config with the required fields
+int config_init(Config *config, const char **valid_fields, const char **print_formats, const FieldType *field_types, int count);
+
+// Add a field found in the header (the name is copied). Returns 0 if memory ran out.
+int config_add_field(Config *config, const char *name, FieldType type);
+void config_free(Config *config);
+
+// Find the column index of a field, or -1 if it is not a valid field
+int find_field(const Config *config, const char *field);
+
+// Allocate the columns for up to capacity rows. Only the columns whose entry
+// in load is set get storage (all of them if load is NULL); the others are
+// left without data.
+int table_init(Table *table, const Config *config, int capacity, const unsigned char *load);
+void table_free(Table *table);
+
+// The storage of a column, whatever its type
+static inline void *column_data(const Column *column) {
+    switch (column->type) {
+        case FIELD_STRING: return column->strings;
+        case FIELD_FLOAT: return column->floats;
+        default: return column->ints;
+    }
+}
+
+// Value of a string column
+static inline const char *column_string(const Table *table, const Column *column, int row) {
+    return string_pool_get(&table->strings, column->strings[row]);
+}
+
+// Value of a numeric column as a double
+double column_value(const Column *column, int row);
+
+int selection_init_all(Selection *selection, int row_count);
+void selection_free(Selection *selection);
+
+// Return the first selected row at or after row, or -1 if there is none
+int selection_next(const Selection *selection, int row);
+
+#endif
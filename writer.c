@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+#include "writer.h"
+
+int writer_init(Writer *writer, FILE *file) {
+    writer->file = file;
+    writer->length = 0;
+    writer->capacity = WRITER_BUFFER_SIZE;
+    writer->buffer = malloc(writer->capacity);
+    if (writer->buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+void writer_flush(Writer *writer) {
+    if (writer->length > 0) {
+        fwrite(writer->buffer, 1, writer->length, writer->file);
+        writer->length = 0;
+    }
+}
+
+void writer_free(Writer *writer) {
+    if (writer->buffer != NULL) {
+        writer_flush(writer);
+        free(writer->buffer);
+        writer->buffer = NULL;
+    }
+}
+
+void writer_bytes(Writer *writer, const void *data, size_t length) {
+    if (writer->length + length > writer->capacity) {
+        writer_flush(writer);
+        if (length > writer->capacity) {
+            fwrite(data, 1, length, writer->file);
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+void writer_string(Writer *writer, const char *text) {
+    writer_bytes(writer, text, strlen(text));
+}
+
+// Function to write the digits of value, padded with zeros to at least width digits
+static void write_digits(Writer *writer, uint64_t value, int width) {
+    char digits[24];
+    int count = 0;
+    do {
+        digits[sizeof(digits) - ++count] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0 || count < width);
+    writer_bytes(writer, digits + sizeof(digits) - count, count);
+}
+
+void writer_int(Writer *writer, long long value) {
+    if (value < 0) {
+        writer_char(writer, '-');
+        write_digits(writer, 0 - (uint64_t)value, 1);
+    } else {
+        write_digits(writer, (uint64_t)value, 1);
+    }
+}
+
+// A finite float rounded to a number of decimals: the value is whole +
+// fraction / 10^decimals. The rounding error is kept in units of 2^shift /
+// 10^decimals so that it can be compared with the distance to the next float.
+typedef struct {
+    int negative;
+    uint64_t whole;
+    uint32_t fraction;
+    int exact;  // The rounded value reads back as the same float
+} Rounded;
+
+static const uint32_t powers_of_ten[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+// Function to round a float to at most six decimals exactly, halfway cases
+// to even as printf does. Returns 0 for infinities, NaNs and values too
+// large for 64 bits.
+static int round_float(float value, int decimals, Rounded *result) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = (bits >> 23) & 0xff;
+    uint64_t mantissa = bits & 0x7fffff;
+    if (exponent == 0xff) {
+        return 0;
+    }
+    // value = mantissa * 2^shift
+    int shift = exponent != 0 ? exponent - 150 : -149;
+    if (exponent != 0) {
+        mantissa |= 0x800000;
+    }
+    uint64_t scale = powers_of_ten[decimals];
+    result->negative = bits >> 31;
+
+    if (shift >= 0) {
+        if (shift > 39) {
+            return 0;
+        }
+        result->whole = mantissa << shift;
+        result->fraction = 0;
+        result->exact = 1;
+        return 1;
+    }
+
+    // value * scale = scaled / 2^-shift, with scaled below 2^44
+    uint64_t scaled = mantissa * scale;
+    uint64_t rounded = 0;
+    uint64_t error;
+    if (-shift >= 45) {
+        error = scaled;  // Less than half of the last decimal; rounds to zero
+    } else {
+        int k = -shift;
+        uint64_t remainder = scaled & ((UINT64_C(1) << k) - 1);
+        uint64_t half = UINT64_C(1) << (k - 1);
+        rounded = scaled >> k;
+        if (remainder > half || (remainder == half && (rounded & 1))) {
+            rounded++;
+            error = (UINT64_C(1) << k) - remainder;
+        } else {
+            error = remainder;
+        }
+    }
+    // The neighbouring floats are 2^shift away, or half that below a power
+    // of two; the value reads back if the error is under half that distance
+    int power_of_two = mantissa == 0x800000 && exponent > 1;
+    result->exact = error * (power_of_two ? 4 : 2) < scale;
+    result->whole = rounded / scale;
+    result->fraction = (uint32_t)(rounded % scale);
+    return 1;
+}
+
+void writer_fixed(Writer *writer, float value) {
+    Rounded r;
+    if (!round_float(value, 6, &r)) {
+        writer_printf(writer, "%f", value);
+        return;
+    }
+    if (r.negative) {
+        writer_char(writer, '-');
+    }
+    write_digits(writer, r.whole, 1);
+    writer_char(writer, '.');
+    write_digits(writer, r.fraction, 6);
+}
+
+void writer_float(Writer *writer, float value) {
+    Rounded r;
+    int decimals = 0;
+    while (decimals <= 6 && round_float(value, decimals, &r) && !r.exact) {
+        decimals++;
+    }
+    if (decimals > 6 || !round_float(value, decimals, &r)) {
+        writer_printf(writer, "%.9g", value);
+        return;
+    }
+    if (r.negative) {
+        writer_char(writer, '-');
+    }
+    write_digits(writer, r.whole, 1);
+    if (decimals > 0) {
+        writer_char(writer, '.');
+        write_digits(writer, r.fraction, decimals);
+    }
+}
+
+void double_text(char *buffer, size_t size, double value) {
+    snprintf(buffer, size, "%.15g", value);
+    if (strtod(buffer, NULL) != value && value == value) {
+        snprintf(buffer, size, "%.17g", value);
+    }
+}
+
+void writer_double(Writer *writer, double value) {
+    char text[32];
+    double_text(text, sizeof(text), value);
+    writer_string(writer, text);
+}
+
+void writer_printf(Writer *writer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t space = writer->capacity - writer->length;
+    int length = vsnprintf(writer->buffer + writer->length, space, format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length < space) {
+        writer->length += length;
+        return;
+    }
+
+    // Did not fit: make room and format again
+    writer_flush(writer);
+    va_start(args, format);
+    if ((size_t)length < writer->capacity) {
+        writer->length = vsnprintf(writer->buffer, writer->capacity, format, args);
+    } else {
+        vfprintf(writer->file, format, args);
+    }
+    va_end(args);
+}
@@ -0,0 +1,52 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Size of the buffer a writer collects output in before handing it to stdio
+#define WRITER_BUFFER_SIZE (256 * 1024)
+
+// Buffered output to a stdio stream, with formatting of numbers that does not
+// go through printf. Whatever was written reaches the stream on
+// writer_flush; anything else writing to the same stream must flush first.
+typedef struct {
+    FILE *file;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+} Writer;
+
+int writer_init(Writer *writer, FILE *file);
+void writer_flush(Writer *writer);
+
+// Flush and release the buffer; the stream stays open
+void writer_free(Writer *writer);
+
+void writer_bytes(Writer *writer, const void *data, size_t length);
+void writer_string(Writer *writer, const char *text);
+
+static inline void writer_char(Writer *writer, char c) {
+    if (writer->length == writer->capacity) {
+        writer_flush(writer);
+    }
+    writer->buffer[writer->length++] = c;
+}
+
+// Integer in decimal, like printf("%lld")
+void writer_int(Writer *writer, long long value);
+
+// Float with six decimals, exactly like printf("%f")
+void writer_fixed(Writer *writer, float value);
+
+// Float with the fewest decimals (up to six) that read back as the same
+// float, or "%.9g" when six decimals are not enough
+void writer_float(Writer *writer, float value);
+
+// Double as "%.15g", or "%.17g" if that is needed to read back the same double
+void writer_double(Writer *writer, double value);
+void double_text(char *buffer, size_t size, double value);
+
+void writer_printf(Writer *writer, const char *format, ...);
+
+#endif